@@ -0,0 +1,49 @@
+/** @file cache.h
+ *
+ * @brief The compiled bytecode cache for the Cube project.
+ *
+ * A compiled script is serialized to a `.cubec` file next to its
+ * source: opcode bytes, line table and a flattened constant pool,
+ * stamped with a hash of the source contents. On the next run the
+ * cache file is memory mapped, validated against the current source
+ * and loaded straight into a Chunk, skipping the scanner and the
+ * compiler entirely. A stale or damaged cache file is simply ignored.
+ *
+ * @author David J. Lains (dlains)
+ * @bug No known bugs.
+ */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "common.h"
+#include "chunk.h"
+#include "vm.h"
+
+/** @brief Load a cached chunk for the given source file.
+ *
+ * Maps the `.cubec` file next to the source, checks the format
+ * version and the stored source hash, and deserializes the bytecode
+ * and constants into the chunk. The chunk is left untouched when the
+ * cache is missing, stale or malformed.
+ *
+ * @param vm The VM whose global slots to rebuild.
+ * @param file_path The full path to the source file.
+ * @param chunk The initialized Chunk to load the bytecode into.
+ * @return True if the chunk was loaded from the cache.
+ */
+bool cache_load(VM *vm, const char *file_path, Chunk *chunk);
+
+/** @brief Store a compiled chunk for the given source file.
+ *
+ * Serializes the chunk to a `.cubec` file next to the source, stamped
+ * with a hash of the current source contents. The write is best
+ * effort: failures (for example a read-only directory) are silently
+ * ignored and the script simply compiles again next run.
+ *
+ * @param vm The VM whose global slot names to store.
+ * @param file_path The full path to the source file.
+ * @param chunk The compiled Chunk to serialize.
+ */
+void cache_store(VM *vm, const char *file_path, Chunk *chunk);
+
+#endif // CACHE_H
@@ -21,6 +21,8 @@ typedef enum {
   OP_CONSTANT,
   OP_POP,
   OP_NIL,
+  OP_TRUE,
+  OP_FALSE,
   OP_GET_LOCAL,
   OP_SET_LOCAL,
   OP_GET_GLOBAL,
@@ -41,20 +43,70 @@ typedef enum {
   OP_JUMP,
   OP_JUMP_IF_FALSE,
   OP_LOOP,
+  // Superinstructions. The compiler's peephole stage fuses the opcode
+  // pairs that dominate hot loops into these, cutting the dispatch and
+  // stack traffic per iteration. They are never emitted directly by
+  // the parse functions.
+  OP_ADD_CONST,                 /**< OP_CONSTANT + OP_ADD. */
+  OP_SUBTRACT_CONST,            /**< OP_CONSTANT + OP_SUBTRACT. */
+  OP_LESS_CONST,                /**< OP_CONSTANT + OP_LESS. */
+  OP_GREATER_CONST,             /**< OP_CONSTANT + OP_GREATER. */
+  OP_JUMP_IF_NOT_LESS,          /**< OP_LESS + OP_JUMP_IF_FALSE, pops both operands. */
+  OP_JUMP_IF_NOT_GREATER,       /**< OP_GREATER + OP_JUMP_IF_FALSE, pops both operands. */
+  OP_JUMP_IF_NOT_LESS_CONST,    /**< OP_LESS_CONST + OP_JUMP_IF_FALSE, pops the operand. */
+  OP_JUMP_IF_NOT_GREATER_CONST, /**< OP_GREATER_CONST + OP_JUMP_IF_FALSE, pops the operand. */
+  // Quickened arithmetic. The generic OP_ADD, OP_SUBTRACT and
+  // OP_MULTIPLY rewrite themselves into these in vm.chunk->code once
+  // they observe their operand types, and the specialized forms
+  // rewrite themselves back when the types change. The compiler never
+  // emits them and they never reach the bytecode cache, which is
+  // written before the code runs.
+  OP_ADD_INT,                   /**< OP_ADD specialized for two integers. */
+  OP_ADD_REAL,                  /**< OP_ADD specialized for two reals. */
+  OP_SUBTRACT_INT,              /**< OP_SUBTRACT specialized for two integers. */
+  OP_SUBTRACT_REAL,             /**< OP_SUBTRACT specialized for two reals. */
+  OP_MULTIPLY_INT,              /**< OP_MULTIPLY specialized for two integers. */
+  OP_MULTIPLY_REAL,             /**< OP_MULTIPLY specialized for two reals. */
+  OP_CONCAT_N,                  /**< Join the top N stack values in one pass. The compiler
+                                     lowers chains of three or more additions to this. */
+  // Wide operand forms, emitted automatically when an index no longer
+  // fits in one byte. The constant index is 24 bits and the slot
+  // indexes are 16 bits, big endian like the jump offsets.
+  OP_CONSTANT_LONG,             /**< OP_CONSTANT with a 24 bit constant index. */
+  OP_GET_LOCAL_LONG,            /**< OP_GET_LOCAL with a 16 bit slot index. */
+  OP_SET_LOCAL_LONG,            /**< OP_SET_LOCAL with a 16 bit slot index. */
+  OP_GET_GLOBAL_LONG,           /**< OP_GET_GLOBAL with a 16 bit slot index. */
+  OP_DEFINE_GLOBAL_LONG,        /**< OP_DEFINE_GLOBAL with a 16 bit slot index. */
+  OP_SET_GLOBAL_LONG,           /**< OP_SET_GLOBAL with a 16 bit slot index. */
+  OP_IMPORT,                    /**< Run the module whose path string is on the stack. */
   OP_RETURN,
 } OpCode;
 
+/** @struct LineRun
+ *
+ * One run of the run-length encoded line table: `count` consecutive
+ * bytecode bytes that all came from source line `line`.
+ */
+typedef struct {
+  int line;   /**< The source line number. */
+  int count;  /**< How many consecutive bytecode bytes it produced. */
+} LineRun;
+
 /** @struct Chunk
  *
  * The Chunk structure defines the dynamic array of byte codes generated
- * by the compiler.
+ * by the compiler. Line numbers are stored run-length encoded since
+ * consecutive bytes almost always share a line and the table is only
+ * read on errors and by the disassembler.
  */
 typedef struct {
   int count;
   int capacity;
   Byte *code;
-  int *lines;
-  ObjectArray constants;
+  LineRun *lines;
+  int line_count;
+  int line_capacity;
+  ValueArray constants;
 } Chunk;
 
 /** @brief Initialize a new Chunk dynamic array.
@@ -73,6 +125,17 @@ void init_chunk(Chunk *chunk);
  */
 void free_chunk(Chunk *chunk);
 
+/** @brief Reset a Chunk for reuse.
+ *
+ * Drop the bytecode and line information but keep the allocated
+ * capacity and the constants, so the REPL can compile line after
+ * line into one chunk without reallocating its arrays or
+ * renumbering the constants earlier lines refer to.
+ *
+ * @param chunk The Chunk array to reset.
+ */
+void chunk_reset(Chunk *chunk);
+
 /** @brief Write a bytecode and its line number to the Chunk array.
  *
  * Add a new bytecode and its associated line number to the
@@ -84,13 +147,24 @@ void free_chunk(Chunk *chunk);
  */
 void write_chunk(Chunk *chunk, Byte byte, int line);
 
-/** @brief Add a new Object to the ObjectArray.
+/** @brief Add a new Value to the ValueArray.
+ *
+ * Adds a value to the ValueArray maintained in the Chunk array.
+ *
+ * @param chunk The Chunk array to add the value to.
+ * @param value The new value to store.
+ */
+int add_constant(Chunk *chunk, Value value);
+
+/** @brief Find the source line for a bytecode offset.
  *
- * Adds an object to the ObjectArray maintained in the Chunk array.
+ * Walks the run-length encoded line table. Only called on the error
+ * path and from the disassembler, so the linear scan is fine.
  *
- * @param chunk The Chunk array to add the object to.
- * @param object The new object to store.
+ * @param chunk The Chunk array holding the line table.
+ * @param offset The bytecode offset to look up.
+ * @return The source line the byte at offset came from.
  */
-int add_constant(Chunk *chunk, Object *object);
+int chunk_get_line(Chunk *chunk, int offset);
 
 #endif // CHUNK_H
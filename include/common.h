@@ -21,8 +21,9 @@ typedef uint8_t Byte;
 /** Make it easier to work with C Strings. */
 typedef char* String;
 
-/** The maximum number of local variables allowed in a block. */
-#define LOCALS_MAX UINT8_MAX + 1
+/** The initial capacity of the compiler's locals array. The array
+ * doubles on demand, so this only sets where the doubling starts. */
+#define LOCALS_MAX (UINT8_MAX + 1)
 
 /** @brief Create a new String.
  *
@@ -47,4 +48,27 @@ String string_init(const char *s);
  */
 String string_copy(const char *s, int length);
 
+/** @brief Create a new String in the compile-time arena.
+ *
+ * Like string_init, but the memory comes from the arena and is
+ * released wholesale with arena_release rather than freed one
+ * string at a time.
+ *
+ * @param s The C String to be copied.
+ * @return The new String containing the original C String.
+ */
+String string_init_arena(const char *s);
+
+/** @brief Create a new String with the given length in the compile-time arena.
+ *
+ * Like string_copy, but the memory comes from the arena and is
+ * released wholesale with arena_release rather than freed one
+ * string at a time.
+ *
+ * @param s The C String to be copied.
+ * @param length The number of characters to be copied.
+ * @return The new String containing the original C String.
+ */
+String string_copy_arena(const char *s, int length);
+
 #endif // COMMON_H
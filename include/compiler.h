@@ -24,6 +24,40 @@
  */
 bool compile(Chunk *chunk);
 
+/** @brief Start a streaming compile of the source in the scanner.
+ *
+ * The streaming entry points split one compile into batches of top
+ * level declarations so the VM can execute each batch while the rest
+ * of the source is still uncompiled. Call compile_begin once, then
+ * compile_step until it reports the end of the source, then
+ * compile_end. The same pooled chunk must be passed to every call;
+ * its constants accumulate across batches so the whole stream shares
+ * one constant pool.
+ *
+ * @param chunk The pooled chunk the batches will compile into.
+ */
+void compile_begin(Chunk *chunk);
+
+/** @brief Compile the next batch of top level declarations.
+ *
+ * Compiles up to the requested number of declarations into the chunk,
+ * which the caller reset beforehand, and finishes the batch with a
+ * return so it can be executed immediately.
+ *
+ * @param chunk The pooled chunk to compile into.
+ * @param declarations The most declarations to compile this batch.
+ * @param more Set to true when source remains after this batch.
+ * @return True if the batch compiled without errors, false otherwise.
+ */
+bool compile_step(Chunk *chunk, int declarations, bool *more);
+
+/** @brief Finish a streaming compile.
+ *
+ * Releases the constant index map and the token lexeme arena held
+ * open across the batches.
+ */
+void compile_end(void);
+
 /** @brief Parse an expression.
  *
  * Parse a full expression and write the byte code to the Chunk array.
@@ -78,4 +78,48 @@
  */
 void *reallocate(void *previous, size_t old_size, size_t new_size, const char *file, int line);
 
+/** @brief Allocate from the compile-time arena.
+ *
+ * Bump-pointer allocation for data that only lives as long as a single
+ * compilation, such as token lexemes. Individual allocations cannot be
+ * freed; the whole arena is released with arena_release.
+ *
+ * @param size The number of bytes to allocate.
+ * @return A pointer to the allocated memory.
+ */
+void *arena_alloc(size_t size);
+
+/** @brief Release everything allocated from the arena.
+ *
+ * Frees all arena pages in one pass when compilation finishes.
+ */
+void arena_release(void);
+
+/** @brief Start recording allocation-site statistics.
+ *
+ * Every reallocate call from here on is attributed to the file and
+ * line its NEW/ALLOC/GROW_ARRAY macro captured, tracking per-site
+ * allocation counts, cumulative bytes and live bytes along with the
+ * heap high-water mark. When profiling is off the only cost is one
+ * predictable branch per reallocate call.
+ */
+void memory_profile_begin(void);
+
+/** @brief Print the allocation-site statistics table.
+ *
+ * Reports each site's allocation count, cumulative bytes and bytes
+ * still live, sorted by live bytes, followed by the heap high-water
+ * mark. Does nothing unless memory_profile_begin was called.
+ */
+void memory_profile_report(void);
+
+/** @brief Run a garbage collection cycle.
+ *
+ * Mark every object reachable from the VM roots (the value stack, the
+ * global variables and the active chunk's constants), drop interned
+ * strings that were not reached, and sweep the remaining unreachable
+ * objects from the vm.objects list.
+ */
+void collect_garbage(void);
+
 #endif // MEMORY_H
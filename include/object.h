@@ -1,8 +1,13 @@
 /** @file object.h
  *
- * @brief Define the Cube object type.
+ * @brief Define the Cube value and object types.
  *
- * Definitions and helper macros for dealing with the Object type.
+ * Values are small tagged structures that live directly in the VM
+ * stack slots and in the constants array. Booleans, nil, integers
+ * and reals are stored immediately in the Value itself, so no heap
+ * allocation is required to create or operate on them. Only larger,
+ * variable sized data such as strings live on the heap as Objects,
+ * with the Value holding a pointer to them.
  *
  * @author David J. Lains (dlains)
  * @bug No known bugs.
@@ -13,98 +18,108 @@
 #include "common.h"
 
 typedef struct object Object;
-typedef struct object_boolean ObjectBoolean;
-typedef struct object_nil ObjectNil;
-typedef struct object_integer ObjectInteger;
-typedef struct object_real ObjectReal;
 typedef struct object_string ObjectString;
 
-/** Retrieve the ObjectType from the given object. */
-#define OBJ_TYPE(object)      (object)->type
+/** Enumerate the different kinds of Values. */
+typedef enum {
+  VAL_BOOLEAN,     /**< The Boolean ValueType. */
+  VAL_NIL,         /**< The Nil ValueType. */
+  VAL_INTEGER,     /**< The Integer ValueType. */
+  VAL_REAL,        /**< The Real ValueType. */
+  VAL_OBJECT,      /**< The ValueType for all heap allocated Objects. */
+  VAL_UNDEFINED,   /**< Internal marker for global slots that have no value yet. Never visible to scripts. */
+} ValueType;
 
-/** Cast the concrete object to a bare object. */
-#define AS_OBJECT(object)     ((Object*)object)
+/** Enumerate the different kinds of Objects. */
+typedef enum {
+  OBJ_STRING,      /**< The String ObjectType. */
+} ObjectType;
 
-/** Check if the given object is a Boolean object. */
-#define IS_BOOLEAN(object)    ((object)->type == OBJ_BOOLEAN)
+/** Define the value structure.
+ *
+ * A Value is a type tag plus a union of the possible payloads. The
+ * whole structure is copied by value, so pushing an integer onto the
+ * VM stack never touches the heap.
+ */
+typedef struct {
+  ValueType type;           /**< This values type. */
+  union {
+    bool boolean;           /**< The boolean payload. */
+    long integer;           /**< The long int payload. */
+    double real;            /**< The double floating point payload. */
+    Object *object;         /**< The heap object payload. */
+  } as;                     /**< The payload for this value. */
+} Value;
 
-/** Check if the given object is a Nil object. */
-#define IS_NIL(object)        ((object)->type == OBJ_NIL)
+/** Retrieve the ValueType from the given value. */
+#define VALUE_TYPE(value)     ((value).type)
 
-/** Check if the given Value is an object with OBJ_INTEGER type. */
-#define IS_INTEGER(object)    ((object)->type == OBJ_INTEGER)
+/** Retrieve the ObjectType from the given value. The value must hold an object. */
+#define OBJ_TYPE(value)       (AS_OBJECT(value)->type)
 
-/** Check if the given object is a Real object. */
-#define IS_REAL(object)       ((object)->type == OBJ_REAL)
+/** Check if the given value is a Boolean value. */
+#define IS_BOOLEAN(value)     ((value).type == VAL_BOOLEAN)
 
-/** Check if the given object is a Real or Integer object. */
-#define IS_NUMBER(object)     (((object)->type == OBJ_INTEGER) || ((object)->type == OBJ_REAL))
+/** Check if the given value is a Nil value. */
+#define IS_NIL(value)         ((value).type == VAL_NIL)
 
-/** Check if the given Value is an object with OBJ_STRING type. */
-#define IS_STRING(object)     ((object)->type == OBJ_STRING)
+/** Check if the given value is an Integer value. */
+#define IS_INTEGER(value)     ((value).type == VAL_INTEGER)
 
-/** Get the Object as a ObjectBoolean pointer. */
-#define AS_BOOLEAN(value)     ((ObjectBoolean*)value)
+/** Check if the given value is a Real value. */
+#define IS_REAL(value)        ((value).type == VAL_REAL)
 
-/** Get the Object as a ObjectNil pointer. */
-#define AS_NIL(value)         ((ObjectNil*)value)
+/** Check if the given value is a Real or Integer value. */
+#define IS_NUMBER(value)      (((value).type == VAL_INTEGER) || ((value).type == VAL_REAL))
 
-/** Get the Value as a ObjectInteger pointer. */
-#define AS_INTEGER(value)     ((ObjectInteger*)value)
+/** Check if the given value holds a heap Object. */
+#define IS_OBJECT(value)      ((value).type == VAL_OBJECT)
 
-/** Get the Value as a ObjectReal pointer. */
-#define AS_REAL(value)        ((ObjectReal*)value)
+/** Check if the given value is the internal undefined marker. */
+#define IS_UNDEFINED(value)   ((value).type == VAL_UNDEFINED)
 
-/** Get the Value as a ObjectString pointer. */
-#define AS_STRING(value)      ((ObjectString*)value)
+/** Check if the given value is an object with OBJ_STRING type. */
+#define IS_STRING(value)      (IS_OBJECT(value) && AS_OBJECT(value)->type == OBJ_STRING)
 
-/** Get the Value as a raw C String pointer. */
-#define AS_CSTRING(value)     (((ObjectString*)value)->chars)
+/** Get the Value payload as a bool. */
+#define AS_BOOLEAN(value)     ((value).as.boolean)
 
-/** Enumerate the different kinds of Objects. */
-typedef enum {
-  OBJ_BOOLEAN,     /**< The Boolean ObjectType. */
-  OBJ_NIL,         /**< The Nil ObjectType. */
-  OBJ_INTEGER,     /**< The Integer ObjectType. */
-  OBJ_REAL,        /**< The Real ObjectType. */
-  OBJ_STRING,      /**< The String ObjectType. */
-} ObjectType;
+/** Get the Value payload as a long. */
+#define AS_INTEGER(value)     ((value).as.integer)
 
-/** Define the object structure. */
-struct object {
-  ObjectType type;          /**< This objects type. */
-  struct object *next;      /**< The next object in the list. */
-};
+/** Get the Value payload as a double. */
+#define AS_REAL(value)        ((value).as.real)
 
-/** Define the object_boolean structure. */
-struct object_boolean {
-  Object object;            /**< The actual object pointer. */
-  bool value;               /**< The boolean value. */
-};
+/** Get the Value payload as a bare Object pointer. */
+#define AS_OBJECT(value)      ((value).as.object)
 
-/** Define the object_nil structure. */
-struct object_nil {
-  Object object;            /**< The actual object pointer. */
-  int value;                /**< Nil is represented as int = 0. */
-};
+/** Get the Value payload as a ObjectString pointer. */
+#define AS_STRING(value)      ((ObjectString*)AS_OBJECT(value))
 
-/** Define the object_integer structure. */
-struct object_integer {
-  Object object;            /**< The actual object pointer. */
-  long value;               /**< The long int value. */
-};
+/** Get the Value payload as a raw C String pointer. */
+#define AS_CSTRING(value)     (((ObjectString*)AS_OBJECT(value))->chars)
 
-/** Define the object_real structure. */
-struct object_real {
-  Object object;            /**< The actual object pointer. */
-  double value;             /**< The double floating point value. */
+/** Define the object structure. */
+struct object {
+  ObjectType type;          /**< This objects type. */
+  bool marked;              /**< Was this object reached during the mark phase of the collector? */
+  struct object *next;      /**< The next object in the list. */
 };
 
-/** Define the object_string structure. */
+/** Define the object_string structure.
+ *
+ * The characters live inline after the header as a flexible array
+ * member, so a string is a single allocation and reading the
+ * characters never chases a second pointer. The hash is computed
+ * once when the string is created; strings are immutable, so it
+ * never needs to be recomputed, no matter how often the tables
+ * holding the string grow.
+ */
 struct object_string {
   Object object;            /**< The actual object pointer. */
   int length;               /**< The length of the string object. */
-  char *chars;              /**< The raw C String pointer. */
+  uint32_t hash;            /**< The hash of the characters, computed at creation. */
+  char chars[];             /**< The characters, stored inline and NUL terminated. */
 };
 
 /** @brief Free the Object resources.
@@ -115,46 +130,65 @@ struct object_string {
  */
 void free_object(Object *object);
 
-/** @brief Create a boolean object.
+/** @brief Create a boolean value.
  *
- * Take the bool value and turn it into a ObjectBoolean.
+ * Take the bool and turn it into an immediate Value.
  *
  * @param value The bool value to convert.
- * @return The newly created ObjectBoolean.
+ * @return The newly created boolean Value.
  */
-ObjectBoolean *create_boolean(bool value);
+Value create_boolean(bool value);
 
-/** @brief Create a nil object.
+/** @brief Create a nil value.
  *
- * Create an ObjectNil constant.
+ * Create an immediate nil Value.
  *
- * @return The newly created ObjectNil.
+ * @return The newly created nil Value.
  */
-ObjectNil *create_nil(void);
+Value create_nil(void);
 
-/** @brief Create an Integer object.
+/** @brief Create an Integer value.
  *
- * Create a new ObjectInteger value.
+ * Take the long and turn it into an immediate Value.
  *
  * @param value The integer value to convert.
- * @return The newly created ObjectInteger.
+ * @return The newly created integer Value.
  */
-ObjectInteger *create_integer(long value);
+Value create_integer(long value);
 
-/** @brief Create a Real object.
+/** @brief Create the undefined marker value.
  *
- * Create a new ObjectReal value.
+ * Used to mark global slots that have been allocated by the compiler
+ * but not yet assigned at runtime.
+ *
+ * @return The newly created undefined Value.
+ */
+Value create_undefined(void);
+
+/** @brief Create a Real value.
+ *
+ * Take the double and turn it into an immediate Value.
  *
  * @param value The double value to convert.
- * @return The newly crated ObjectReal.
+ * @return The newly created real Value.
  */
-ObjectReal *create_real(double value);
+Value create_real(double value);
+
+/** @brief Create an object value.
+ *
+ * Wrap a heap allocated Object in a Value.
+ *
+ * @param object The Object to wrap.
+ * @return The newly created object Value.
+ */
+Value create_object(Object *object);
 
 /** @brief Take a string and turn it into a ObjectString.
  *
- * Copies the C String into an ObjectString.
+ * Copies the C String into an ObjectString and frees the passed in
+ * buffer, so the caller hands over ownership either way.
  *
- * @param chars The C String to copy.
+ * @param chars The C String to take.
  * @param length The length of the C String.
  * @return The new ObjectString.
  */
@@ -170,80 +204,103 @@ ObjectString *take_string(char *chars, int length);
  */
 ObjectString *copy_string(const char *chars, int length);
 
-/** @brief Check if Objects are equivalent.
+/** @brief Concatenate a run of string values into one new string.
+ *
+ * Sizes the result once, copies each piece into it once and interns
+ * it, so assembling a string from many pieces stays linear. The
+ * caller must keep the pieces reachable on the VM stack, since the
+ * allocation can trigger a collection.
+ *
+ * @param pieces The string values to join, in order.
+ * @param count The number of pieces.
+ * @return The ObjectString with the joined characters.
+ */
+ObjectString *concat_strings(Value *pieces, int count);
+
+/** @brief Check if Values are equivalent.
+ *
+ * Check if the passed in values are equivalent.
+ *
+ * @param a The first Value to check.
+ * @param b The second Value to check.
+ * @return True if the underlying values are equivalent, false otherwise.
+ */
+bool values_equal(Value a, Value b);
+
+/** @brief Print the value to stdout.
  *
- * Check if the passed in objects are equivalent.
+ * Print the given value to stdout.
  *
- * @param a The first Object to check.
- * @param b The second Object to check.
- * @return True if the underlying Objects are equivalent, false otherwise.
+ * @param value The value to print.
  */
-bool objects_equal(Object *a, Object *b);
+void print_value(Value value);
 
-/** @brief Print the object value to stdout.
+/** @brief Format the value into the output writer.
  *
- * Print the given object to stdout.
+ * The buffered counterpart of print_value, used by OP_PRINT. Values
+ * are converted straight into the writer's buffer so printing costs
+ * no stdio call per value.
  *
- * @param value The object value to print.
+ * @param value The value to write.
  */
-void print_object(Object *object);
+void write_value(Value value);
 
-/** @brief Calculate a hash value for the object
+/** @brief Calculate a hash value for the value.
  *
- * Determine the type of object and calculate a hash value for it.
+ * Determine the type of value and calculate a hash value for it.
+ * String values return their cached hash without touching the
+ * character data.
  *
- * @param object The object to generate the hash for.
- * @param table_size The current hash table size.
- * @return The object's hash
+ * @param value The value to generate the hash for.
+ * @return The value's hash
  */
-int object_hash(Object *object, int table_size);
+uint32_t value_hash(Value value);
 
 /** @brief Generate a hash value for a string.
  *
- * Three kinds of objects generate a hash with a C string,
- * OBJ_STRING, OBJ_BOOLEAN, and OBJ_NIL. This function handles
- * all three cases.
+ * FNV-1a over the characters. The result is independent of any
+ * table size; tables reduce it modulo their own capacity.
  *
- * @param string The C string to hash
- * @param table_size The current hash table size.
+ * @param string The characters to hash.
+ * @param length The number of characters to hash.
  * @return The hash of the string.
  */
-int string_hash(const char *string, int table_size);
+uint32_t string_hash(const char *string, int length);
 
-/** @struct ObjectArray
+/** @struct ValueArray
  *
- * A dynamic array to store objects found in the
+ * A dynamic array to store values found in the
  * source code.
  */
 typedef struct {
   int capacity;
   int count;
-  Object **objects;
-} ObjectArray;
+  Value *values;
+} ValueArray;
 
-/** @brief Initialize a new object array.
+/** @brief Initialize a new value array.
  *
- * Allocate space for the initial object array structure.
+ * Allocate space for the initial value array structure.
  *
- * @param array The ObjectArray structure to initialize.
+ * @param array The ValueArray structure to initialize.
  */
-void init_object_array(ObjectArray *array);
+void init_value_array(ValueArray *array);
 
-/** @brief Free the memory for the given ObjectArray.
+/** @brief Free the memory for the given ValueArray.
  *
- * Release the memory used for the given ObjectArray.
+ * Release the memory used for the given ValueArray.
  *
- * @param array The ObjectArray to free.
+ * @param array The ValueArray to free.
  */
-void free_object_array(ObjectArray *array);
+void free_value_array(ValueArray *array);
 
-/** @brief Write a new object to the array.
+/** @brief Write a new value to the array.
  *
- * Add a new object to the given array.
+ * Add a new value to the given array.
  *
- * @param array The ObjectArray to add the value to.
- * @param value The object to add.
+ * @param array The ValueArray to add the value to.
+ * @param value The value to add.
  */
-void write_object_array(ObjectArray *array, Object *object);
+void write_value_array(ValueArray *array, Value value);
 
 #endif // OBJECT_H
@@ -60,4 +60,28 @@ const char *options_get_script(Options options);
  */
 bool options_get_show_code(Options options);
 
+/** @brief Get the memory option.
+ *
+ * Get the memory option from the Options structure.
+ *
+ * @return The memory option.
+ */
+bool options_get_memory(Options options);
+
+/** @brief Get the profile option.
+ *
+ * Get the profile option from the Options structure.
+ *
+ * @return The profile option.
+ */
+bool options_get_profile(Options options);
+
+/** @brief Get the registers option.
+ *
+ * Get the registers option from the Options structure.
+ *
+ * @return The registers option.
+ */
+bool options_get_registers(Options options);
+
 #endif // OPTIONS_H
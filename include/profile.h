@@ -0,0 +1,59 @@
+/** @file profile.h
+ *
+ * @brief The opcode execution profiler for the Cube VM.
+ *
+ * When the interpreter is built with `make profile` (which defines
+ * PROFILE) and run with the -p / --profile option, every dispatch in
+ * run() funnels through profile_step(). The profiler counts how often
+ * each opcode and each source line executes and how much wall time
+ * they accumulate, and prints a ranked report when the VM shuts down.
+ *
+ * None of this exists in a normal build: the hooks in vm.c are
+ * compiled out entirely unless PROFILE is defined, so the hot loop
+ * pays nothing when profiling is off.
+ *
+ * @author David J. Lains (dlains)
+ * @bug No known bugs.
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "common.h"
+
+#ifdef PROFILE
+
+/** @brief Turn the profiler on for this process.
+ *
+ * Called when the -p / --profile option is given. Resets the
+ * accumulated counts so the report covers a single session.
+ */
+void profile_begin(void);
+
+/** @brief Is the profiler collecting?
+ *
+ * @return True once profile_begin has been called.
+ */
+bool profile_enabled(void);
+
+/** @brief Record and consume the next instruction.
+ *
+ * Attributes the elapsed time since the previous step to the opcode
+ * and line that just finished, then counts the instruction the VM is
+ * about to execute and advances the instruction pointer past its
+ * opcode byte, exactly as READ_BYTE would.
+ *
+ * @return The opcode byte to dispatch on.
+ */
+Byte profile_step(void);
+
+/** @brief Print the ranked profile report.
+ *
+ * Lists every executed opcode and source line with its execution
+ * count, accumulated wall time and share of the total, ordered by
+ * accumulated time. Does nothing when the profiler never ran.
+ */
+void profile_report(void);
+
+#endif // PROFILE
+
+#endif // PROFILE_H
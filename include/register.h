@@ -0,0 +1,120 @@
+/** @file register.h
+ *
+ * @brief The experimental register bytecode backend.
+ *
+ * Translates a compiled stack chunk into register code in which every
+ * operand names an explicit slot, so an expression like a = b + c * d
+ * runs as two instructions instead of eight stack moves. The register
+ * file is the VM value stack: locals already live at fixed stack
+ * slots, so stack position p simply becomes register p and the
+ * translation assigns temporaries the slots they would have occupied
+ * anyway.
+ *
+ * The backend is selected at runtime with -r / --registers so the two
+ * executors can be A/B compared on the same build. A chunk that uses
+ * something the translator does not cover (wide operand forms, more
+ * than 256 registers or constants) falls back to the stack loop, so
+ * the flag is always safe to pass.
+ *
+ * @author David J. Lains (dlains)
+ * @bug No known bugs.
+ */
+#ifndef REGISTER_H
+#define REGISTER_H
+
+#include "chunk.h"
+
+/** The register file size limit. Operands are one byte, and the
+ * register file lives in the value stack, so this also bounds the
+ * stack window the register code can touch. */
+#define REGISTER_MAX 256
+
+/** @enum The register instruction set.
+ *
+ * Operands follow the opcode one byte each unless noted. dst, a, b
+ * and src are register numbers, k is a constant index, s16 is a two
+ * byte global slot and off16 a two byte jump distance, both big
+ * endian like the stack code.
+ */
+typedef enum
+{
+  REG_LOAD_CONST,           /**< dst, k: load a constant. */
+  REG_LOAD_NIL,             /**< dst: load nil. */
+  REG_LOAD_TRUE,            /**< dst: load true. */
+  REG_LOAD_FALSE,           /**< dst: load false. */
+  REG_MOVE,                 /**< dst, src: copy a register. */
+  REG_GET_GLOBAL,           /**< dst, s16: read a global slot. */
+  REG_SET_GLOBAL,           /**< s16, src: write a global slot. */
+  REG_DEFINE_GLOBAL,        /**< s16, src: define a global slot. */
+  REG_ADD,                  /**< dst, a, b: add or concatenate. */
+  REG_SUBTRACT,             /**< dst, a, b */
+  REG_MULTIPLY,             /**< dst, a, b */
+  REG_DIVIDE,               /**< dst, a, b */
+  REG_MODULUS,              /**< dst, a, b */
+  REG_POWER,                /**< dst, a, b */
+  REG_EQUAL,                /**< dst, a, b */
+  REG_GREATER,              /**< dst, a, b */
+  REG_LESS,                 /**< dst, a, b */
+  REG_ADD_C,                /**< dst, a, k: add a constant. */
+  REG_SUBTRACT_C,           /**< dst, a, k */
+  REG_MULTIPLY_C,           /**< dst, a, k */
+  REG_GREATER_C,            /**< dst, a, k */
+  REG_LESS_C,               /**< dst, a, k */
+  REG_NOT,                  /**< dst, src */
+  REG_NEGATE,               /**< dst, src */
+  REG_PRINT,                /**< src */
+  REG_CONCAT_N,             /**< base, count: concatenate registers base.. */
+  REG_IMPORT,               /**< src: import the module named in src. */
+  REG_JUMP,                 /**< off16: jump forward. */
+  REG_JUMP_IF_FALSE,        /**< src, off16: jump forward when src is falsey. */
+  REG_JUMP_IF_NOT_LESS,     /**< a, b, off16: compare and branch. */
+  REG_JUMP_IF_NOT_GREATER,  /**< a, b, off16 */
+  REG_JUMP_IF_NOT_LESS_C,   /**< a, k, off16 */
+  REG_JUMP_IF_NOT_GREATER_C,/**< a, k, off16 */
+  REG_LOOP,                 /**< off16: jump backward. */
+  REG_RETURN                /**< End of the code. */
+} RegOp;
+
+/** @struct A translated register chunk.
+ *
+ * Holds the register code, a source line per code byte for error
+ * reporting, and the number of registers the code touches. The
+ * constants are borrowed from the stack chunk the code was
+ * translated from, which stays alive for the whole run.
+ */
+typedef struct
+{
+  int count;                /**< The number of code bytes in use. */
+  int capacity;             /**< The allocated size of code and lines. */
+  Byte *code;               /**< The register instruction stream. */
+  int *lines;               /**< The source line for each code byte. */
+  int registers;            /**< How many registers the code uses. */
+  ValueArray *constants;    /**< The constants, borrowed from the stack chunk. */
+} RegChunk;
+
+/** @brief Translate a stack chunk into register code.
+ *
+ * Walks the stack bytecode tracking where each stack position's value
+ * currently lives - a register or a pending constant - and emits
+ * register instructions only when a value is produced, so plain loads
+ * disappear into the operands of their consumers. Everything is
+ * materialized into its home slot before jumps and jump targets, so
+ * all control flow paths agree on where values live.
+ *
+ * @param chunk The compiled stack chunk to translate.
+ * @param reg The register chunk to fill in.
+ * @return True on success, false when the chunk uses something the
+ * translator does not cover and the stack loop should run instead.
+ */
+bool register_translate(Chunk *chunk, RegChunk *reg);
+
+/** @brief Free the code of a translated register chunk.
+ *
+ * The borrowed constants belong to the stack chunk and are left
+ * alone.
+ *
+ * @param reg The register chunk to free.
+ */
+void register_free(RegChunk *reg);
+
+#endif // REGISTER_H
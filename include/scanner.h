@@ -71,14 +71,25 @@ void activate_next_buffer();
  */
 void remove_current_buffer();
 
-/** @brief Get the next token from the source code.
+/** @brief The number of tokens filled per scan_tokens call.
  *
- * Get the next token from the source code. If there is a problem
- * the token type returned will be TOKEN_ERROR. If there are no more
- * tokens in the source code it will return a token type of TOKEN_EOF.
+ * @def TOKEN_BATCH_SIZE is sized so a batch of tokens stays resident
+ * in cache while the parser works through it.
+ */
+#define TOKEN_BATCH_SIZE 64
+
+/** @brief Fill a caller provided array with scanned tokens.
+ *
+ * Scans up to count tokens into the array in one call, so the parser
+ * pays the scanner call overhead once per batch instead of once per
+ * token. A batch always ends early at the first TOKEN_EOF, which is
+ * included, so the caller can deal with the source buffer stack
+ * before asking for more. Error tokens are included like any other.
  *
- * @return Token the next token found in the source code.
+ * @param tokens The array to fill with scanned tokens.
+ * @param count The capacity of the array.
+ * @return The number of tokens placed in the array.
  */
-Token next_token();
+int scan_tokens(Token *tokens, int count);
 
 #endif // SCANNER_H
@@ -123,6 +123,19 @@ bool is_at_end(Source s);
  */
 void skip_whitespace(Source s);
 
+/** @brief Advance to the next occurrence of a character.
+ *
+ * Moves the current pointer to the next occurrence of the given
+ * character, or to the end of the buffer when it does not occur
+ * again. The library search routines scan whole words at a time, so
+ * this is the fast path for comment bodies and string literals. The
+ * line and column counters are updated in bulk for the skipped span.
+ *
+ * @param s The source buffer to advance.
+ * @param c The character to stop at.
+ */
+void advance_to(Source s, char c);
+
 /** @brief Advance the scanner on character and return the current character.
  *
  * Move the current pointer on character forward and return
@@ -12,31 +12,32 @@
 #include "object.h"
 
 /** @struct Entry
- * A Table entry consists of an Object* key and it's corresponding
- * Object* value.
+ * A Table entry consists of a Value key and it's corresponding
+ * Value value, stored inline in the table's flat entries array.
  *
- * Ideally the key can be any type supported by the Cube language and
- * can reference a value of any type.
+ * A nil key marks a slot with no live entry: the slot is empty when
+ * the value is also nil, and a tombstone left behind by table_delete
+ * when the value is boolean true. Nil is therefore reserved and can
+ * not be used as a key.
  */
-typedef struct entry *Entry;
-
-struct entry {
-  Object *key;
-  Object *value;
-  Entry next;
-};
+typedef struct entry {
+  Value key;
+  Value value;
+} Entry;
 
 /** @struct Table
- * The Table struct defines the Symbol Table. The parent table pointer
- * will only be used for nested scopes.
+ * The Table struct defines the Symbol Table. Collisions are handled
+ * with open addressing and linear probing over the entries array, so
+ * a lookup walks adjacent slots instead of chasing pointers. The
+ * parent table pointer will only be used for nested scopes.
  */
 typedef struct table *Table;
 
 struct table {
-  int count;
-  int capacity;
-  Entry *entries;
-  Table parent;
+  int count;        /**< Live entries plus tombstones. */
+  int capacity;     /**< The size of the entries array. */
+  Entry *entries;   /**< The flat array of slots. */
+  Table parent;     /**< The enclosing scope, if any. */
 };
 
 /** @brief Initialize a new symbol table.
@@ -62,21 +63,24 @@ void table_free(Table table);
  * Search the symbol table for an entry matching the given key.
  *
  * @param table The symbol table to search in.
- * @param key The Object key to look for.
- * @return The Object value found for the key, or null if the key is not in the symbol table.
+ * @param key The Value key to look for.
+ * @return A pointer to the Value found for the key, or null if the key is not in the symbol table.
  */
-Object *table_search(Table table, Object *key);
+Value *table_search(Table table, Value key);
 
 /** @brief Search the symbol table for a C string.
  *
- * Search the symbol table for a C string entry.
+ * Search the symbol table for a C string entry. The caller passes
+ * the hash of the characters so interning can hash a string exactly
+ * once and reuse it here and at creation.
  *
  * @param table The symbol table to search in.
  * @param string The C String to search for.
  * @param length The length of the C String..
- * @return The Object value found for the key, or null if the key is not in the symbol table.
+ * @param hash The precomputed hash of the C String.
+ * @return The interned ObjectString found for the key, or null if the key is not in the symbol table.
  */
-Object *table_search_string(Table table, const char *string, int length);
+ObjectString *table_search_string(Table table, const char *string, int length, uint32_t hash);
 
 /** @brief Add a new entry to the symbol table.
  *
@@ -84,10 +88,10 @@ Object *table_search_string(Table table, const char *string, int length);
  * into the symbol table.
  *
  * @param table The symbol table to insert the new entry into.
- * @param key The Object key to assign to the Entry key.
- * @param value The Object value to assign to the Entry value.
+ * @param key The Value key to assign to the Entry key.
+ * @param value The Value to assign to the Entry value.
  */
-void table_insert(Table table, Object *key, Object *value);
+void table_insert(Table table, Value key, Value value);
 
 /** @brief Remove an Entry from the symbol table.
  *
@@ -95,9 +99,9 @@ void table_insert(Table table, Object *key, Object *value);
  * remove it from the symbol table.
  *
  * @param table The symbol table to delete the Entry from.
- * @param key The Object key to find the Entry with.
+ * @param key The Value key to find the Entry with.
  */
-void table_delete(Table table, Object *key);
+void table_delete(Table table, Value key);
 
 /** @brief Merge two symbol tables into a single table.
  *
@@ -64,6 +64,7 @@ typedef enum
   TOKEN_ENSURE,
   TOKEN_FALSE,
   TOKEN_IF,
+  TOKEN_IMPORT,
   TOKEN_NEXT,
   TOKEN_NIL,
   TOKEN_PRINT,
@@ -111,14 +112,6 @@ Token token_create(TokenType type, String lexeme, int line, int col);
  */
 Token token_duplicate(Token source);
 
-/** @brief Free the tokens resources.
- *
- * Check to see if lexeme is not null. If not, free the memory.
- *
- * @param token The token to free.
- */
-void token_free(Token token);
-
 /** @brief Translate a token enum id to a user friendly token name.
  *
  * This function returns the token name for a given token id. If the token
@@ -16,7 +16,24 @@
 #include "table.h"
 #include "options.h"
 
-#define STACK_MAX 256
+/** The initial capacity of the value stack. The stack doubles on
+ * demand, so this only sets where the doubling starts. */
+#define STACK_INITIAL 256
+
+/** @struct An imported module.
+ *
+ * Each imported file is compiled once into its own chunk, which stays
+ * resident in the VM and is shared by reference by every later import
+ * of the same path. An import of a path already in the registry,
+ * including one still being loaded, is a no-op, which also breaks
+ * import cycles.
+ */
+typedef struct Module
+{
+  struct Module *next;        /**< The next module in the registry list. */
+  ObjectString *path;         /**< The file path the module was loaded from. */
+  Chunk chunk;                /**< The compiled bytecode for the module. */
+} Module;
 
 /** @struct The virtual machine structure.
  *
@@ -25,17 +42,23 @@
 typedef struct
 {
   Chunk *chunk;               /**< Pointer to the Chunk array of compiled code. */
+  Chunk *script_chunk;        /**< The top level chunk, kept as a GC root while imports run. */
   Byte *ip;                   /**< The instruction pointer. This is the next operation to perform. */
   Options options;            /**< The command line options. */
-  Object *stack[STACK_MAX];   /**< The object stack to hold intermediate results during processing. */
-  Object **stack_top;         /**< Pointer to the top of the object stack. */
-  Table globals;              /**< Global variables. */
+  Value *stack;               /**< The value stack to hold intermediate results during processing. */
+  Value *stack_top;           /**< Pointer to the top of the value stack. */
+  Value *frame;               /**< Base of the running chunk's local slots. The stack base for the
+                                   script, the importer's stack top while a module body runs. */
+  int stack_capacity;         /**< The number of Value slots currently allocated for the stack. */
+  Table globals;              /**< Maps global variable names to their slot index. */
+  ValueArray global_slots;    /**< The values of the global variables, indexed by slot. */
   Table strings;              /**< Interned strings. */
+  Module *modules;            /**< Imported modules, keyed by path. */
   Object *objects;            /**< Linked list of objects. */
+  size_t bytes_allocated;     /**< Running total of bytes currently allocated. */
+  size_t next_gc;             /**< The bytes_allocated threshold that triggers the next collection. */
 } VM;
 
-extern VM vm;
-
 /** @enum Iterpret results enumeration.
  *
  * Result of interpreting the code.
@@ -47,45 +70,107 @@ typedef enum
   INTERPRET_RUNTIME_ERROR    /**< There was a runtime error while running the code. */
 } InterpretResult;
 
-/** @brief Initialize the virtual machine.
+/** @brief Initialize a virtual machine isolate.
  *
- * Create the VM structure and store any command line
- * options that were provided.
+ * Set up the caller-provided VM structure and store any command line
+ * options that were provided. The VM becomes the active isolate on
+ * the calling thread.
  *
+ * @param vm The VM to initialize.
  * @param options The command line options.
  */
-void vm_init(Options options);
+void vm_init(VM *vm, Options options);
 
 /** @brief Free the resources used by the virtual machine.
  *
  * Release any memory and resources used by the virtual machine.
+ *
+ * @param vm The VM to free.
+ */
+void vm_free(VM *vm);
+
+/** @brief The VM bound to the current thread.
+ *
+ * @return The active isolate, or NULL before vm_init has run on this thread.
+ */
+VM *vm_active(void);
+
+/** @brief Bind a VM to the current thread.
+ *
+ * The modules that cannot carry a VM parameter - the allocator, the
+ * string interner and the compiler's global slot table - operate on
+ * the active isolate. One VM is active per thread at a time.
+ *
+ * @param vm The VM to make active on this thread.
  */
-void vm_free();
+void vm_activate(VM *vm);
 
 /** @brief Interpret the current code.
  *
  * The compiler adds code the the VM and this function
  * determines what should happen based on the OpCode.
  *
+ * @param vm The VM to run on.
  * @return The interpret results lets the caller know if there
  * was a compilation error, a runtime error or no error.
  */
-InterpretResult interpret();
+InterpretResult interpret(VM *vm);
+
+/** @brief Compile and run the scanner source in streamed batches.
+ *
+ * Pipelines compilation with execution: batches of top level
+ * declarations are compiled into a pooled chunk and run as soon as
+ * each is ready, so a large script starts producing output before the
+ * compiler reaches the end of the source. A batch that fails to
+ * compile stops the stream, so earlier batches will already have run,
+ * unlike interpret, which runs nothing on a compile error.
+ *
+ * @param vm The VM to run on.
+ * @return The interpret result of running the source.
+ */
+InterpretResult interpret_stream(VM *vm);
+
+/** @brief Compile and run one REPL line in a pooled chunk.
+ *
+ * Compiles the current scanner source into the caller's chunk, which
+ * is reset but keeps its capacity and constants across calls, so a
+ * session of many small lines reuses one set of arrays instead of
+ * allocating and freeing them per line.
+ *
+ * @param vm The VM to run on.
+ * @param chunk The pooled chunk owned by the REPL loop.
+ * @return The interpret result of running the line.
+ */
+InterpretResult interpret_line(VM *vm, Chunk *chunk);
+
+/** @brief Run an already compiled chunk.
+ *
+ * Execute a chunk that is ready to run, whether it was just compiled
+ * or loaded from the bytecode cache. Shows the bytecode first when
+ * the dump option is set.
+ *
+ * @param vm The VM to run on.
+ * @param chunk The chunk to execute.
+ * @return The interpret result of running the code.
+ */
+InterpretResult interpret_chunk(VM *vm, Chunk *chunk);
 
-/** @brief Push an object onto the stack.
+/** @brief Push a value onto the stack.
  *
- * Places an object at the top of the runtime stack.
+ * Places a value at the top of the runtime stack.
  *
- * @param object The object to put on the stack.
+ * @param vm The VM whose stack to push onto.
+ * @param value The value to put on the stack.
  */
-void push(Object *object);
+void push(VM *vm, Value value);
 
-/** @brief Remove an object from the stack.
+/** @brief Remove a value from the stack.
  *
- * Removes and returns the top object from the runtime stack.
+ * Removes and returns the top value from the runtime stack.
  *
- * @return The top Object from the stack.
+ * @param vm The VM whose stack to pop from.
+ * @return The top Value from the stack.
  */
-Object *pop();
+Value pop(VM *vm);
 
 #endif // VM_H
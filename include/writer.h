@@ -0,0 +1,64 @@
+/** @file writer.h
+ *
+ * @brief The buffered output writer for the Cube VM.
+ *
+ * OP_PRINT formats values into a large user-space buffer instead of
+ * issuing a printf call per value. The buffer is flushed when it
+ * fills, when interpret() returns and before a runtime error is
+ * reported, so a script that prints millions of lines performs a
+ * handful of large writes rather than millions of tiny ones.
+ *
+ * @author David J. Lains (dlains)
+ * @bug No known bugs.
+ */
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+#include "common.h"
+
+/** The size of the output buffer in bytes. */
+#define WRITER_BUFFER_SIZE 65536
+
+/** @brief Append raw characters to the output buffer.
+ *
+ * Flushes first when the characters do not fit, and writes spans
+ * larger than the whole buffer straight through.
+ *
+ * @param chars The characters to append.
+ * @param length The number of characters to append.
+ */
+void writer_string(const char *chars, size_t length);
+
+/** @brief Append a single character to the output buffer.
+ *
+ * @param c The character to append.
+ */
+void writer_char(char c);
+
+/** @brief Format an integer into the output buffer.
+ *
+ * Converts the value directly, avoiding printf format parsing for
+ * the most common printed type.
+ *
+ * @param value The integer to append.
+ */
+void writer_integer(long value);
+
+/** @brief Format a real into the output buffer.
+ *
+ * Matches the %g formatting the VM has always used for reals.
+ *
+ * @param value The real to append.
+ */
+void writer_real(double value);
+
+/** @brief Write the buffered output to stdout.
+ *
+ * Called when the buffer fills, when interpret() returns and on the
+ * runtime error path, so buffered output always lands before any
+ * error message.
+ */
+void writer_flush(void);
+
+#endif // WRITER_H
@@ -0,0 +1,411 @@
+/** @file cache.c
+ *
+ * @brief Implementation of the compiled bytecode cache.
+ *
+ * @author David J. Lains (dlains)
+ * @bug No known bugs.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "memory.h"
+#include "object.h"
+#include "cache.h"
+#include "vm.h"
+
+/** The magic bytes at the start of every cache file. */
+#define CACHE_MAGIC "CUBC"
+
+/** Bump this whenever the chunk or serialization layout changes. */
+#define CACHE_VERSION 7
+
+/** @struct CacheHeader
+ *
+ * The fixed-size header at the start of a cache file. Everything
+ * after it is the opcode bytes, the line table and the serialized
+ * constant pool, in that order.
+ */
+typedef struct {
+  char magic[4];          /**< Always CACHE_MAGIC. */
+  uint32_t version;       /**< The CACHE_VERSION that wrote the file. */
+  uint64_t source_hash;   /**< Hash of the source file contents. */
+  int32_t code_count;     /**< Number of opcode bytes. */
+  int32_t line_run_count; /**< Number of runs in the line table. */
+  int32_t constant_count; /**< Number of constants in the pool. */
+  int32_t global_count;   /**< Number of global slots the code indexes, with their names after the constants. */
+} CacheHeader;
+
+/** The serialization tags for the constant pool. */
+enum {
+  CACHE_CONST_INTEGER,
+  CACHE_CONST_REAL,
+  CACHE_CONST_STRING,
+};
+
+/** @brief Build the cache file path for a source file.
+ *
+ * Appends a `c` to a `.cube` source path, or `.cubec` to anything
+ * else, so the cache always sits next to its source.
+ *
+ * @param file_path The full path to the source file.
+ * @return The heap-allocated cache path. The caller frees it.
+ */
+static char *cache_path(const char *file_path);
+
+/** @brief Hash the contents of the source file.
+ *
+ * FNV-1a over the raw bytes of the file. The hash is stored in the
+ * cache header and compared on load, so any edit to the source
+ * invalidates the cache.
+ *
+ * @param file_path The full path to the source file.
+ * @param hash Receives the hash on success.
+ * @return True if the file could be read and hashed.
+ */
+static bool cache_source_hash(const char *file_path, uint64_t *hash);
+
+/** @brief Build the cache file path for a source file.
+ *
+ * Appends a `c` to a `.cube` source path, or `.cubec` to anything
+ * else, so the cache always sits next to its source.
+ *
+ * @param file_path The full path to the source file.
+ * @return The heap-allocated cache path. The caller frees it.
+ */
+static char *cache_path(const char *file_path)
+{
+  size_t length = strlen(file_path);
+  char *path = ALLOC(char, length + 7);
+
+  strcpy(path, file_path);
+  if(length >= 5 && strcmp(file_path + length - 5, ".cube") == 0)
+    strcat(path, "c");
+  else
+    strcat(path, ".cubec");
+
+  return path;
+}
+
+/** @brief Hash the contents of the source file.
+ *
+ * FNV-1a over the raw bytes of the file. The hash is stored in the
+ * cache header and compared on load, so any edit to the source
+ * invalidates the cache.
+ *
+ * @param file_path The full path to the source file.
+ * @param hash Receives the hash on success.
+ * @return True if the file could be read and hashed.
+ */
+static bool cache_source_hash(const char *file_path, uint64_t *hash)
+{
+  FILE *file = fopen(file_path, "rb");
+  if(file == NULL)
+    return false;
+
+  uint64_t h = 14695981039346656037ULL;
+  Byte buffer[4096];
+  size_t bytes;
+  while((bytes = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    for(size_t i = 0; i < bytes; i++)
+    {
+      h ^= buffer[i];
+      h *= 1099511628211ULL;
+    }
+  }
+
+  fclose(file);
+  *hash = h;
+  return true;
+}
+
+/** @brief Load a cached chunk for the given source file.
+ *
+ * Maps the `.cubec` file next to the source, checks the format
+ * version and the stored source hash, and deserializes the bytecode
+ * and constants into the chunk. The chunk is left untouched when the
+ * cache is missing, stale or malformed.
+ *
+ * @param file_path The full path to the source file.
+ * @param chunk The initialized Chunk to load the bytecode into.
+ * @return True if the chunk was loaded from the cache.
+ */
+bool cache_load(VM *vm, const char *file_path, Chunk *chunk)
+{
+  // The cached code indexes global slots counted from zero, so it can
+  // only run in a VM that has not allocated any slots yet. That is
+  // always the case when running a script file.
+  if(vm->global_slots.count != 0)
+    return false;
+
+  uint64_t source_hash;
+  if(!cache_source_hash(file_path, &source_hash))
+    return false;
+
+  char *path = cache_path(file_path);
+  int fd = open(path, O_RDONLY);
+  FREE_ARRAY(char, path, strlen(path) + 1);
+  if(fd == -1)
+    return false;
+
+  struct stat info;
+  if(fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(CacheHeader))
+  {
+    close(fd);
+    return false;
+  }
+
+  size_t size = (size_t)info.st_size;
+  Byte *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED)
+    return false;
+
+  CacheHeader header;
+  memcpy(&header, data, sizeof(CacheHeader));
+  if(memcmp(header.magic, CACHE_MAGIC, 4) != 0
+     || header.version != CACHE_VERSION
+     || header.source_hash != source_hash
+     || header.code_count <= 0
+     || header.line_run_count < 0
+     || header.constant_count < 0
+     || header.global_count < 0 || header.global_count > UINT16_MAX + 1)
+  {
+    munmap(data, size);
+    return false;
+  }
+
+  // Every read below is bounds checked against the remaining bytes so
+  // a truncated or corrupted file just falls back to compiling.
+  const Byte *at = data + sizeof(CacheHeader);
+  size_t remaining = size - sizeof(CacheHeader);
+
+#define CACHE_READ(destination, bytes)\
+  do {\
+    if(remaining < (size_t)(bytes))\
+      goto malformed;\
+    memcpy((destination), at, (bytes));\
+    at += (bytes);\
+    remaining -= (bytes);\
+  } while(false)
+
+  chunk->count         = header.code_count;
+  chunk->capacity      = header.code_count;
+  chunk->line_count    = header.line_run_count;
+  chunk->line_capacity = header.line_run_count;
+  chunk->code          = ALLOC(Byte, header.code_count);
+  chunk->lines         = ALLOC(LineRun, header.line_run_count);
+  CACHE_READ(chunk->code, header.code_count * sizeof(Byte));
+  CACHE_READ(chunk->lines, header.line_run_count * sizeof(LineRun));
+
+  // run() only stops at OP_RETURN, so a code stream that does not end
+  // with one would walk the instruction pointer off the end of the
+  // array.
+  if(chunk->code[header.code_count - 1] != OP_RETURN)
+    goto malformed;
+
+  for(int i = 0; i < header.constant_count; i++)
+  {
+    Byte tag;
+    CACHE_READ(&tag, sizeof(Byte));
+
+    Value value;
+    switch(tag)
+    {
+      case CACHE_CONST_INTEGER:
+      {
+        long integer;
+        CACHE_READ(&integer, sizeof(long));
+        value = create_integer(integer);
+        break;
+      }
+      case CACHE_CONST_REAL:
+      {
+        double real;
+        CACHE_READ(&real, sizeof(double));
+        value = create_real(real);
+        break;
+      }
+      case CACHE_CONST_STRING:
+      {
+        int32_t length;
+        CACHE_READ(&length, sizeof(int32_t));
+        if(length <= 0 || remaining < (size_t)length)
+          goto malformed;
+        value = create_object((Object*)copy_string((const char*)at, length));
+        at += length;
+        remaining -= length;
+        break;
+      }
+      default:
+        goto malformed;
+    }
+
+    // Root the value while the constants array grows, since the
+    // growth can trigger a collection.
+    push(vm, value);
+    write_value_array(&chunk->constants, value);
+    pop(vm);
+  }
+
+  // Recreate the global slots the compiler would have allocated,
+  // binding each stored name to its slot index so undefined-variable
+  // messages still name the variable.
+  for(int i = 0; i < header.global_count; i++)
+  {
+    int32_t length;
+    CACHE_READ(&length, sizeof(int32_t));
+    if(length <= 0 || remaining < (size_t)length)
+      goto malformed;
+
+    ObjectString *name = copy_string((const char*)at, length);
+    at += length;
+    remaining -= length;
+
+    push(vm, create_object((Object*)name));
+    write_value_array(&vm->global_slots, create_undefined());
+    table_insert(vm->globals, create_object((Object*)name), create_integer(i));
+    pop(vm);
+  }
+
+#undef CACHE_READ
+
+  munmap(data, size);
+  return true;
+
+malformed:
+  munmap(data, size);
+  free_chunk(chunk);
+  init_chunk(chunk);
+  return false;
+}
+
+/** @brief Store a compiled chunk for the given source file.
+ *
+ * Serializes the chunk to a `.cubec` file next to the source, stamped
+ * with a hash of the current source contents. The write is best
+ * effort: failures (for example a read-only directory) are silently
+ * ignored and the script simply compiles again next run.
+ *
+ * @param file_path The full path to the source file.
+ * @param chunk The compiled Chunk to serialize.
+ */
+void cache_store(VM *vm, const char *file_path, Chunk *chunk)
+{
+  uint64_t source_hash;
+  if(!cache_source_hash(file_path, &source_hash))
+    return;
+
+  char *path = cache_path(file_path);
+  size_t path_length = strlen(path);
+
+  // Write to a temporary file first and rename it into place, so a
+  // concurrent launch never sees a half-written cache.
+  char *temp = ALLOC(char, path_length + 5);
+  strcpy(temp, path);
+  strcat(temp, ".tmp");
+
+  FILE *file = fopen(temp, "wb");
+  if(file == NULL)
+  {
+    FREE_ARRAY(char, path, path_length + 1);
+    FREE_ARRAY(char, temp, path_length + 5);
+    return;
+  }
+
+  CacheHeader header;
+  memcpy(header.magic, CACHE_MAGIC, 4);
+  header.version        = CACHE_VERSION;
+  header.source_hash    = source_hash;
+  header.code_count     = chunk->count;
+  header.line_run_count = chunk->line_count;
+  header.constant_count = chunk->constants.count;
+  header.global_count   = vm->global_slots.count;
+
+  bool ok = fwrite(&header, sizeof(CacheHeader), 1, file) == 1
+         && fwrite(chunk->code, sizeof(Byte), chunk->count, file) == (size_t)chunk->count
+         && fwrite(chunk->lines, sizeof(LineRun), chunk->line_count, file) == (size_t)chunk->line_count;
+
+  for(int i = 0; ok && i < chunk->constants.count; i++)
+  {
+    Value value = chunk->constants.values[i];
+    Byte tag;
+    switch(VALUE_TYPE(value))
+    {
+      case VAL_INTEGER:
+      {
+        long integer = AS_INTEGER(value);
+        tag = CACHE_CONST_INTEGER;
+        ok = fwrite(&tag, sizeof(Byte), 1, file) == 1
+          && fwrite(&integer, sizeof(long), 1, file) == 1;
+        break;
+      }
+      case VAL_REAL:
+      {
+        double real = AS_REAL(value);
+        tag = CACHE_CONST_REAL;
+        ok = fwrite(&tag, sizeof(Byte), 1, file) == 1
+          && fwrite(&real, sizeof(double), 1, file) == 1;
+        break;
+      }
+      case VAL_OBJECT:
+      {
+        ObjectString *string = AS_STRING(value);
+        int32_t length = string->length;
+        tag = CACHE_CONST_STRING;
+        ok = fwrite(&tag, sizeof(Byte), 1, file) == 1
+          && fwrite(&length, sizeof(int32_t), 1, file) == 1
+          && fwrite(string->chars, sizeof(char), length, file) == (size_t)length;
+        break;
+      }
+      default:
+        // Booleans and nil compile to dedicated opcodes, not constants.
+        ok = false;
+        break;
+    }
+  }
+
+  // Store the global names in slot order so a cold VM can rebuild the
+  // same slot numbering the compiler used.
+  for(int slot = 0; ok && slot < vm->global_slots.count; slot++)
+  {
+    ObjectString *name = NULL;
+    for(int i = 0; i < vm->globals->capacity; i++)
+    {
+      Entry *e = &vm->globals->entries[i];
+      if(IS_STRING(e->key) && AS_INTEGER(e->value) == (long)slot)
+      {
+        name = AS_STRING(e->key);
+        break;
+      }
+    }
+
+    if(name == NULL)
+    {
+      ok = false;
+      break;
+    }
+
+    int32_t length = name->length;
+    ok = fwrite(&length, sizeof(int32_t), 1, file) == 1
+      && fwrite(name->chars, sizeof(char), length, file) == (size_t)length;
+  }
+
+  ok = fclose(file) == 0 && ok;
+
+  if(ok)
+    rename(temp, path);
+  else
+    remove(temp);
+
+  FREE_ARRAY(char, path, path_length + 1);
+  FREE_ARRAY(char, temp, path_length + 5);
+}
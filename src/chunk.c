@@ -10,6 +10,7 @@
 #include "chunk.h"
 #include "memory.h"
 #include "object.h"
+#include "vm.h"
 
 /** @brief Initialize a new Chunk dynamic array.
  *
@@ -23,7 +24,9 @@ void init_chunk(Chunk *chunk)
   chunk->capacity = 0;
   chunk->code = NULL;
   chunk->lines = NULL;
-  init_object_array(&chunk->constants);
+  chunk->line_count = 0;
+  chunk->line_capacity = 0;
+  init_value_array(&chunk->constants);
 }
 
 /** @brief Free a Chunk dynamic array.
@@ -35,11 +38,26 @@ void init_chunk(Chunk *chunk)
 void free_chunk(Chunk *chunk)
 {
   FREE_ARRAY(Byte, chunk->code, chunk->capacity);
-  FREE_ARRAY(int, chunk->lines, chunk->capacity);
-  free_object_array(&chunk->constants);
+  FREE_ARRAY(LineRun, chunk->lines, chunk->line_capacity);
+  free_value_array(&chunk->constants);
   init_chunk(chunk);
 }
 
+/** @brief Reset a Chunk for reuse.
+ *
+ * Drop the bytecode and line information but keep the allocated
+ * capacity and the constants, so the REPL can compile line after
+ * line into one chunk without reallocating its arrays or
+ * renumbering the constants earlier lines refer to.
+ *
+ * @param chunk The Chunk array to reset.
+ */
+void chunk_reset(Chunk *chunk)
+{
+  chunk->count      = 0;
+  chunk->line_count = 0;
+}
+
 /** @brief Write a bytecode and its line number to the Chunk array.
  *
  * Add a new bytecode and its associated line number to the
@@ -56,23 +74,64 @@ void write_chunk(Chunk *chunk, Byte byte, int line)
     int old_size    = chunk->capacity;
     chunk->capacity = GROW_CAPACITY(old_size);
     chunk->code     = GROW_ARRAY(chunk->code, Byte, old_size, chunk->capacity);
-    chunk->lines    = GROW_ARRAY(chunk->lines, int, old_size, chunk->capacity);
   }
 
   chunk->code[chunk->count] = byte;
-  chunk->lines[chunk->count] = line;
   chunk->count++;
+
+  // Extend the current line run when possible, otherwise start a new one.
+  if(chunk->line_count > 0 && chunk->lines[chunk->line_count - 1].line == line)
+  {
+    chunk->lines[chunk->line_count - 1].count++;
+    return;
+  }
+
+  if(chunk->line_capacity < chunk->line_count + 1)
+  {
+    int old_size         = chunk->line_capacity;
+    chunk->line_capacity = GROW_CAPACITY(old_size);
+    chunk->lines         = GROW_ARRAY(chunk->lines, LineRun, old_size, chunk->line_capacity);
+  }
+
+  chunk->lines[chunk->line_count].line  = line;
+  chunk->lines[chunk->line_count].count = 1;
+  chunk->line_count++;
 }
 
-/** @brief Add a new Object to the ObjectArray.
+/** @brief Add a new Value to the ValueArray.
  *
- * Adds an object to the ObjectArray maintained in the Chunk array.
+ * Adds a value to the ValueArray maintained in the Chunk array.
  *
- * @param chunk The Chunk array to add the object to.
- * @param object The new object to store.
+ * @param chunk The Chunk array to add the value to.
+ * @param value The new value to store.
  */
-int add_constant(Chunk *chunk, Object *object)
+int add_constant(Chunk *chunk, Value value)
 {
-  write_object_array(&chunk->constants, object);
+  // Root the value on the VM stack while the constants array grows,
+  // since the growth itself can trigger a collection.
+  push(vm_active(), value);
+  write_value_array(&chunk->constants, value);
+  pop(vm_active());
   return chunk->constants.count - 1;
 }
+
+/** @brief Find the source line for a bytecode offset.
+ *
+ * Walks the run-length encoded line table. Only called on the error
+ * path and from the disassembler, so the linear scan is fine.
+ *
+ * @param chunk The Chunk array holding the line table.
+ * @param offset The bytecode offset to look up.
+ * @return The source line the byte at offset came from.
+ */
+int chunk_get_line(Chunk *chunk, int offset)
+{
+  for(int i = 0; i < chunk->line_count; i++)
+  {
+    offset -= chunk->lines[i].count;
+    if(offset < 0)
+      return chunk->lines[i].line;
+  }
+
+  return 0;
+}
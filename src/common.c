@@ -55,4 +55,49 @@ String string_copy(const char *s, int length)
   return result;
 }
 
+/** @brief Create a new String in the compile-time arena.
+ *
+ * Like string_init, but the memory comes from the arena and is
+ * released wholesale with arena_release rather than freed one
+ * string at a time.
+ *
+ * @param s The C String to be copied.
+ * @return The new String containing the original C String.
+ */
+String string_init_arena(const char *s)
+{
+  if(!s)
+    DIE("Invalid string pointer.");
+
+  String result = arena_alloc(strlen(s) + 1);
+  strcpy(result, s);
+
+  return result;
+}
+
+/** @brief Create a new String with the given length in the compile-time arena.
+ *
+ * Like string_copy, but the memory comes from the arena and is
+ * released wholesale with arena_release rather than freed one
+ * string at a time.
+ *
+ * @param s The C String to be copied.
+ * @param length The number of characters to be copied.
+ * @return The new String containing the original C String.
+ */
+String string_copy_arena(const char *s, int length)
+{
+  if(!s)
+    DIE("Invalid string pointer.");
+
+  if(length <= 0)
+    DIE("String length must be larger than zero.");
+
+  String result = arena_alloc(length + 1);
+  strncpy(result, s, length);
+  result[length] = '\0';
+
+  return result;
+}
+
 
@@ -9,10 +9,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 #include "common.h"
+#include "memory.h"
 #include "object.h"
 #include "compiler.h"
 #include "scanner.h"
+#include "vm.h"
 
 /** @struct Parser
  *
@@ -27,9 +30,36 @@ typedef struct {
   bool panic_mode; /**< Is the compiler in panic mode? */
 } Parser;
 
-Parser parser;           /**< Global Parser struct used by the compiler. */
+__thread Parser parser;  /**< Per-thread Parser struct used by the compiler. */
 
-Chunk *compiling_chunk;  /**< Global Chunk used by the compiler. */
+/** The batch of tokens most recently filled by the scanner. */
+static __thread Token token_buffer[TOKEN_BATCH_SIZE];
+
+/** The number of tokens in the current batch. */
+static __thread int token_count = 0;
+
+/** The next unconsumed token in the current batch. */
+static __thread int token_index = 0;
+
+__thread Chunk *compiling_chunk;  /**< Per-thread Chunk used by the compiler. */
+
+/** Maps each constant Value already in the chunk to its index, so
+ * repeated literals share a single constants slot. */
+static __thread struct table constant_indexes;
+
+/** The offset of an OP_CONSTANT instruction that is the most recently
+ * emitted instruction, or -1 when the peephole stage cannot fuse it. */
+static __thread int fusable_constant = -1;
+
+/** The offset of a comparison instruction that is the most recently
+ * emitted instruction, or -1 when the peephole stage cannot fuse it. */
+static __thread int fusable_compare = -1;
+
+/** The offset of an OP_CONSTANT instruction immediately preceding the
+ * one fusable_constant tracks, or -1. When both are set the last two
+ * instructions push literals, so an operator on them can be folded at
+ * compile time. */
+static __thread int fusable_constant_prev = -1;
 
 /** @enum Precedence
  *
@@ -83,12 +113,13 @@ typedef struct {
  * able to access it later.
  */
 typedef struct Compiler {
-  Local locals[LOCALS_MAX]; /**< Array of Local structs to hold the local variables. */
+  Local *locals;            /**< Array of Local structs to hold the local variables. */
   int local_count;          /**< The current count of local variables. */
+  int local_capacity;       /**< The number of Local slots currently allocated. */
   int scope_depth;          /**< The current scope depth. Zero is the global scope. */
 } Compiler;
 
-Compiler *current = NULL;   /** Global Compiler struct to hold data for the VM to use. */
+__thread Compiler *current = NULL;   /** Per-thread Compiler struct to hold data for the VM to use. */
 
 /** @brief Initialize the compiler data.
  *
@@ -300,6 +331,12 @@ static void variable(bool can_assign);
  */
 static void var_declaration();
 
+/** @brief Parse an import declaration.
+ *
+ * Parse an import declaration.
+ */
+static void import_declaration();
+
 /** @brief Parse an expression statement.
  *
  * Parse an expression statement.
@@ -337,17 +374,17 @@ static void parse_precedence(Precedence precedence);
  * Parse a variable and create an identifier.
  *
  * @param error_message The error message to display if the parse fails.
- * @return The index of the constant for the identifier.
+ * @return The global slot index for the identifier.
  */
-static Byte parse_variable(const char *error_message);
+static int parse_variable(const char *error_message);
 
 /** @brief Define a variable.
  *
  * Define a global variable and emit the necessary op codes.
  *
- * @param global The constant index to the global identifier.
+ * @param global The global slot index for the identifier.
  */
-static void define_variable(Byte global);
+static void define_variable(int global);
 
 /** @brief Compile a reference to a variable.
  *
@@ -358,15 +395,17 @@ static void define_variable(Byte global);
  */
 static void named_variable(Token name, bool can_assign);
 
-/** @brief Create a constant for the identifier token.
+/** @brief Resolve an identifier to its global slot.
  *
- * Create a constant for the identifier and return the index
- * to the constant.
+ * Look the identifier up in the VM's global name table and return its
+ * slot index, allocating a fresh slot the first time a name is seen.
+ * The slot is resolved once here at compile time, so the VM indexes
+ * straight into the globals array with no hashing at run time.
  *
- * @param token The identifier token to turn into a constant.
- * @return The constant index for the identifier.
+ * @param token The identifier token to resolve.
+ * @return The global slot index for the identifier.
  */
-static Byte identifier_constant(Token *token);
+static int global_slot(Token *token);
 
 /*
  * Compiler Functions
@@ -433,22 +472,33 @@ static void patch_jump(int offset);
  */
 static void end_compiler();
 
-/** @brief Emit an object constant operation.
+/** @brief Emit a constant operation.
+ *
+ * Add the byte codes to access a constant value to the Chunk array.
+ *
+ * @param value The constant value to reference.
+ */
+static void emit_constant(Value value);
+
+/** @brief Make a new constant.
  *
- * Add the byte codes to access an object to the Chunk array.
+ * Add a value to the list of constants in the Chunk.
  *
- * @param object The object constant to reference.
+ * @param value The value to make a constant for.
+ * @return The index to the value in the Chunk.
  */
-static void emit_constant(Object *object);
+static int make_constant(Value value);
 
-/** @brief Make a new object.
+/** @brief Emit an instruction with a one or two byte index operand.
  *
- * Add an object to the list of constants in the Chunk.
+ * Uses the single byte opcode when the index fits, otherwise the wide
+ * form with the index in two big endian bytes.
  *
- * @param object The object to make.
- * @return The index to the object in the Chunk.
+ * @param op The opcode with a one byte operand.
+ * @param op_long The opcode with a two byte operand.
+ * @param index The index operand.
  */
-static Byte make_constant(Object *object);
+static void emit_indexed(Byte op, Byte op_long, int index);
 
 /** @brief Emit a return byte code.
  *
@@ -456,6 +506,61 @@ static Byte make_constant(Object *object);
  */
 static void emit_return();
 
+/** @brief Fuse a trailing OP_CONSTANT into a superinstruction.
+ *
+ * When the most recently emitted instruction is an OP_CONSTANT, its
+ * opcode byte is rewritten in place to the fused opcode, which keeps
+ * the constant index operand and absorbs the operator that was about
+ * to be emitted.
+ *
+ * @param fused The superinstruction to rewrite the OP_CONSTANT to.
+ * @return True if the fusion happened, false if the operator must be emitted as usual.
+ */
+static bool fuse_constant_operand(Byte fused);
+
+/** @brief Fold an operator over trailing literal operands.
+ *
+ * When the last one or two instructions push literal constants, the
+ * operator that was about to be emitted is evaluated at compile time
+ * instead. The literal pushes are removed from the chunk and replaced
+ * with a single constant, or with OP_TRUE / OP_FALSE for comparison
+ * results, which compile to dedicated opcodes rather than constants.
+ *
+ * @param type The operator token about to be emitted.
+ * @return True if the expression was folded, false if the operator must be emitted as usual.
+ */
+static bool fold_binary(TokenType type);
+
+/** @brief Fold a unary operator over a trailing literal operand.
+ *
+ * @param type The operator token about to be emitted.
+ * @return True if the expression was folded, false if the operator must be emitted as usual.
+ */
+static bool fold_unary(TokenType type);
+
+/** @brief Remove trailing literal pushes from the chunk.
+ *
+ * Truncates the bytecode back to the given offset, trimming the line
+ * table to match, so the folder can replace literal pushes with their
+ * computed result.
+ *
+ * @param offset The chunk offset to truncate back to.
+ */
+static void rewind_chunk(int offset);
+
+/** @brief Fuse a trailing comparison into a conditional exit jump.
+ *
+ * When the condition of an if or while statement ends in a comparison
+ * instruction, the comparison is rewritten in place to a fused
+ * compare-and-branch opcode and the jump offset placeholder is
+ * appended to it. The fused opcodes consume their operands, so the
+ * caller must not emit the usual OP_POPs for the condition value.
+ *
+ * @param jump_offset Receives the offset of the jump placeholder, as emit_jump would return.
+ * @return True if the fusion happened, false if an OP_JUMP_IF_FALSE must be emitted as usual.
+ */
+static bool fuse_compare_jump(int *jump_offset);
+
 /*
  * Error Handling Functions
  */
@@ -490,10 +595,25 @@ bool compile(Chunk *chunk)
   init_compiler(&main_compiler);
 
   compiling_chunk = chunk;
+  table_init(&constant_indexes);
+
+  // A chunk that already holds constants is the REPL's pooled chunk
+  // coming back for another line. Seeding the index map from them
+  // lets the new line share the slots earlier lines created instead
+  // of growing the constant pool with duplicates.
+  for(int i = 0; i < chunk->constants.count; i++)
+    table_insert(&constant_indexes, chunk->constants.values[i], create_integer(i));
+  fusable_constant      = -1;
+  fusable_constant_prev = -1;
+  fusable_compare       = -1;
 
   parser.had_error = false;
   parser.panic_mode = false;
 
+  // Drop any tokens batched from a previous compile.
+  token_count = 0;
+  token_index = 0;
+
   advance();
 
   if(!match(TOKEN_EOF))
@@ -504,9 +624,91 @@ bool compile(Chunk *chunk)
   }
 
   end_compiler();
+  table_free(&constant_indexes);
+
+  // Token lexemes are only needed during compilation, so the whole
+  // arena holding them can be released in one pass.
+  arena_release();
+
   return !parser.had_error;
 }
 
+/** The compiler state for a streaming compile. compile() keeps its
+ * Compiler on the stack for the span of the one call, but the
+ * streaming entry points return between batches, so theirs lives
+ * here. */
+static __thread Compiler stream_compiler;
+
+/** @brief Start a streaming compile of the source in the scanner.
+ *
+ * Mirrors the setup in compile, with the constant index map and the
+ * lexeme arena held open until compile_end so every batch shares one
+ * constant pool and the parser can look ahead across a batch
+ * boundary.
+ *
+ * @param chunk The pooled chunk the batches will compile into.
+ */
+void compile_begin(Chunk *chunk)
+{
+  init_compiler(&stream_compiler);
+
+  compiling_chunk = chunk;
+  table_init(&constant_indexes);
+
+  parser.had_error = false;
+  parser.panic_mode = false;
+
+  // Drop any tokens batched from a previous compile.
+  token_count = 0;
+  token_index = 0;
+
+  advance();
+}
+
+/** @brief Compile the next batch of top level declarations.
+ *
+ * Compiles up to the requested number of declarations into the chunk,
+ * which the caller reset beforehand, and finishes the batch with a
+ * return so it can be executed immediately. Batches split only
+ * between top level declarations, so every local scope opens and
+ * closes inside one batch.
+ *
+ * @param chunk The pooled chunk to compile into.
+ * @param declarations The most declarations to compile this batch.
+ * @param more Set to true when source remains after this batch.
+ * @return True if the batch compiled without errors, false otherwise.
+ */
+bool compile_step(Chunk *chunk, int declarations, bool *more)
+{
+  compiling_chunk = chunk;
+
+  // The reset emptied the chunk's code, so positions the folder and
+  // the fuser remembered from the previous batch are gone.
+  fusable_constant      = -1;
+  fusable_constant_prev = -1;
+  fusable_compare       = -1;
+
+  for(int i = 0; i < declarations && !check(TOKEN_EOF); i++)
+    declaration();
+
+  end_compiler();
+
+  *more = !check(TOKEN_EOF) && !parser.had_error;
+
+  return !parser.had_error;
+}
+
+/** @brief Finish a streaming compile.
+ *
+ * Releases the constant index map and the token lexeme arena held
+ * open across the batches.
+ */
+void compile_end(void)
+{
+  table_free(&constant_indexes);
+  arena_release();
+}
+
 /** @brief Initialize the compiler data.
  *
  * Set the Compiler data structure fields to their initial values.
@@ -515,7 +717,9 @@ bool compile(Chunk *chunk)
  */
 static void init_compiler(Compiler *compiler)
 {
+  compiler->locals = NULL;
   compiler->local_count = 0;
+  compiler->local_capacity = 0;
   compiler->scope_depth = 0;
 
   current = compiler;
@@ -542,7 +746,6 @@ static void end_scope(void)
   while(current->local_count > 0 && current->locals[current->local_count - 1].depth > current->scope_depth)
   {
     emit_byte(OP_POP);
-    token_free(current->locals[current->local_count - 1].name);
     current->local_count--;
   }
 }
@@ -599,12 +802,20 @@ static int resolve_local(Compiler *compiler, Token *name, bool in_function)
  */
 static void add_local(Token name)
 {
-  if(current->local_count == LOCALS_MAX)
+  // The wide opcode forms index slots with sixteen bits.
+  if(current->local_count > UINT16_MAX)
   {
     error(&name, "Too many local variables in function.");
     return;
   }
 
+  if(current->local_capacity < current->local_count + 1)
+  {
+    int old_capacity = current->local_capacity;
+    current->local_capacity = old_capacity == 0 ? LOCALS_MAX : old_capacity * 2;
+    current->locals = GROW_ARRAY(current->locals, Local, old_capacity, current->local_capacity);
+  }
+
   Local *local = &current->locals[current->local_count];
   local->name = token_duplicate(name);
   local->depth = -1;
@@ -694,6 +905,7 @@ ParseRule rules[] = {
   { NULL,     NULL,    PREC_NONE },       // TOKEN_ENSURE
   { literal,  NULL,    PREC_NONE },       // TOKEN_FALSE
   { NULL,     NULL,    PREC_NONE },       // TOKEN_IF
+  { NULL,     NULL,    PREC_NONE },       // TOKEN_IMPORT
   { NULL,     NULL,    PREC_NONE },       // TOKEN_NEXT
   { literal,  NULL,    PREC_NONE },       // TOKEN_NIL
   { NULL,     NULL,    PREC_NONE },       // TOKEN_RESCUE
@@ -730,12 +942,16 @@ static ParseRule *get_rule(TokenType type)
  */
 static void advance(void)
 {
-  token_free(parser.previous);
   parser.previous = parser.current;
 
   for(;;)
   {
-    parser.current = next_token();
+    if(token_index == token_count)
+    {
+      token_count = scan_tokens(token_buffer, TOKEN_BATCH_SIZE);
+      token_index = 0;
+    }
+    parser.current = token_buffer[token_index++];
 
     if(parser.current.type == TOKEN_EOF)
     {
@@ -861,6 +1077,12 @@ static void binary(bool can_assign)
   ParseRule *rule = get_rule(type);
   parse_precedence((Precedence)(rule->precedence + 1));
 
+  // When both operands are literals the operator is evaluated right
+  // here. Folding runs left to right, so `60 * 60 * 24` collapses to
+  // a single constant one operator at a time.
+  if(fold_binary(type))
+    return;
+
   // Emit the operator instruction.
   switch(type)
   {
@@ -871,22 +1093,58 @@ static void binary(bool can_assign)
       emit_byte(OP_EQUAL);
       break;
     case TOKEN_GREATER:
-      emit_byte(OP_GREATER);
+      if(!fuse_constant_operand(OP_GREATER_CONST))
+      {
+        emit_byte(OP_GREATER);
+        fusable_compare = current_chunk()->count - 1;
+      }
       break;
     case TOKEN_GREATER_EQUAL:
-      emit_bytes(OP_LESS, OP_NOT);
+      if(fuse_constant_operand(OP_LESS_CONST))
+        emit_byte(OP_NOT);
+      else
+        emit_bytes(OP_LESS, OP_NOT);
       break;
     case TOKEN_LESS:
-      emit_byte(OP_LESS);
+      if(!fuse_constant_operand(OP_LESS_CONST))
+      {
+        emit_byte(OP_LESS);
+        fusable_compare = current_chunk()->count - 1;
+      }
       break;
     case TOKEN_LESS_EQUAL:
-      emit_bytes(OP_GREATER, OP_NOT);
+      if(fuse_constant_operand(OP_GREATER_CONST))
+        emit_byte(OP_NOT);
+      else
+        emit_bytes(OP_GREATER, OP_NOT);
       break;
     case TOKEN_PLUS:
-      emit_byte(OP_ADD);
+      // Lower a chain of three or more additions to a single
+      // OP_CONCAT_N, which assembles a string result in one pass
+      // instead of reallocating at every `+`. The operand count is a
+      // byte, so an absurdly long chain is flushed in segments.
+      if(check(TOKEN_PLUS))
+      {
+        int pieces = 2;
+        while(match(TOKEN_PLUS))
+        {
+          parse_precedence((Precedence)(rule->precedence + 1));
+          pieces++;
+          if(pieces == UINT8_MAX)
+          {
+            emit_bytes(OP_CONCAT_N, (Byte)pieces);
+            pieces = 1;
+          }
+        }
+        if(pieces > 1)
+          emit_bytes(OP_CONCAT_N, (Byte)pieces);
+      }
+      else if(!fuse_constant_operand(OP_ADD_CONST))
+        emit_byte(OP_ADD);
       break;
     case TOKEN_MINUS:
-      emit_byte(OP_SUBTRACT);
+      if(!fuse_constant_operand(OP_SUBTRACT_CONST))
+        emit_byte(OP_SUBTRACT);
       break;
     case TOKEN_STAR:
       emit_byte(OP_MULTIPLY);
@@ -919,13 +1177,13 @@ static void literal(bool can_assign)
   switch(parser.previous.type)
   {
     case TOKEN_FALSE:
-      emit_constant(AS_OBJECT(create_boolean(false)));
+      emit_byte(OP_FALSE);
       break;
     case TOKEN_NIL:
-      emit_constant(AS_OBJECT(create_nil()));
+      emit_byte(OP_NIL);
       break;
     case TOKEN_TRUE:
-      emit_constant(AS_OBJECT(create_boolean(true)));
+      emit_byte(OP_TRUE);
       break;
     default:
       return;
@@ -944,7 +1202,7 @@ static void integer(bool can_assign)
   (void)can_assign;
 
   long value = strtol(parser.previous.lexeme, NULL, 10);
-  emit_constant(AS_OBJECT(create_integer(value)));
+  emit_constant(create_integer(value));
 }
 
 /** @brief Parse an real number.
@@ -959,7 +1217,7 @@ static void real(bool can_assign)
   (void)can_assign;
 
   double value = strtod(parser.previous.lexeme, NULL);
-  emit_constant(AS_OBJECT(create_real(value)));
+  emit_constant(create_real(value));
 }
 
 /** @brief Parse a string object.
@@ -973,7 +1231,7 @@ static void string(bool can_assign)
   // Prevent unused parameter error. Not all ParseFn functions actually use the parameter.
   (void)can_assign;
 
-  emit_constant(AS_OBJECT(copy_string(parser.previous.lexeme, strlen(parser.previous.lexeme))));
+  emit_constant(create_object((Object*)copy_string(parser.previous.lexeme, strlen(parser.previous.lexeme))));
 }
 
 /** @brief Parse a grouped expression.
@@ -1006,6 +1264,10 @@ static void unary(bool can_assign)
 
   parse_precedence(PREC_UNARY);
 
+  // A literal operand negates or inverts at compile time.
+  if(fold_unary(type))
+    return;
+
   switch(type)
   {
     case TOKEN_BANG:
@@ -1065,6 +1327,10 @@ static void declaration()
   {
     var_declaration();
   }
+  else if(match(TOKEN_IMPORT))
+  {
+    import_declaration();
+  }
   else
   {
     statement();
@@ -1119,7 +1385,7 @@ static void variable(bool can_assign)
  */
 static void var_declaration()
 {
-  Byte global = parse_variable("Expect variable name.");
+  int global = parse_variable("Expect variable name.");
 
   if(match(TOKEN_EQUAL))
   {
@@ -1137,6 +1403,21 @@ static void var_declaration()
   define_variable(global);
 }
 
+/** @brief Parse an import declaration.
+ *
+ * The file path is stored as an ordinary string constant and the
+ * module itself is compiled lazily by the VM when OP_IMPORT first
+ * runs, so importing a file costs nothing until the import statement
+ * is actually reached.
+ */
+static void import_declaration()
+{
+  consume(TOKEN_STRING, "Expect a file path after 'import'.");
+  emit_constant(create_object((Object*)copy_string(parser.previous.lexeme, strlen(parser.previous.lexeme))));
+  emit_byte(OP_IMPORT);
+  consume(TOKEN_SEMICOLON, "Expect ';' after import path.");
+}
+
 /** @brief Parse an expression statement.
  *
  * Parse an expression statement.
@@ -1158,11 +1439,17 @@ static void if_statement()
   expression();
   consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
 
-  // Jump to the else branch of the condition is false.
-  int else_jump = emit_jump(OP_JUMP_IF_FALSE);
+  // Jump to the else branch if the condition is false. A condition
+  // ending in a comparison fuses into a single compare-and-branch that
+  // consumes its operands, so neither branch pops a condition value.
+  int else_jump;
+  bool fused = fuse_compare_jump(&else_jump);
+  if(!fused)
+    else_jump = emit_jump(OP_JUMP_IF_FALSE);
 
   // Compile the then branch.
-  emit_byte(OP_POP);
+  if(!fused)
+    emit_byte(OP_POP);
   statement();
 
   // Jump over the else branch when the if branch is taken.
@@ -1170,7 +1457,8 @@ static void if_statement()
 
   // Compile the else branch.
   patch_jump(else_jump);
-  emit_byte(OP_POP);
+  if(!fused)
+    emit_byte(OP_POP);
 
   if(match(TOKEN_ELSE))
     statement();
@@ -1190,18 +1478,25 @@ static void while_statement()
   expression();
   consume(TOKEN_RIGHT_PAREN, "Expect ')' after condition.");
 
-  // Jump out of the loop if the condition is false.
-  int exit_jump = emit_jump(OP_JUMP_IF_FALSE);
+  // Jump out of the loop if the condition is false. A condition
+  // ending in a comparison fuses into a single compare-and-branch that
+  // consumes its operands, so neither path pops a condition value.
+  int exit_jump;
+  bool fused = fuse_compare_jump(&exit_jump);
+  if(!fused)
+    exit_jump = emit_jump(OP_JUMP_IF_FALSE);
 
   // Compile the body.
-  emit_byte(OP_POP);
+  if(!fused)
+    emit_byte(OP_POP);
   statement();
 
   // Loop back to start.
   emit_loop(loop_start);
 
   patch_jump(exit_jump);
-  emit_byte(OP_POP);
+  if(!fused)
+    emit_byte(OP_POP);
 }
 
 /** @brief Parse a print statement.
@@ -1257,12 +1552,12 @@ static void parse_precedence(Precedence precedence)
  * @param error_message The error message to display if the parse fails.
  * @return The index of the constant for the identifier.
  */
-static Byte parse_variable(const char *error_message)
+static int parse_variable(const char *error_message)
 {
   consume(TOKEN_IDENTIFIER, error_message);
 
   if(current->scope_depth == 0)
-    return identifier_constant(&parser.previous);
+    return global_slot(&parser.previous);
 
   declare_variable();
 
@@ -1275,10 +1570,10 @@ static Byte parse_variable(const char *error_message)
  *
  * @param global The constant index to the global identifier.
  */
-static void define_variable(Byte global)
+static void define_variable(int global)
 {
   if(current->scope_depth == 0)
-    emit_bytes(OP_DEFINE_GLOBAL, global);
+    emit_indexed(OP_DEFINE_GLOBAL, OP_DEFINE_GLOBAL_LONG, global);
   else
     current->locals[current->local_count - 1].depth = current->scope_depth;
 }
@@ -1292,42 +1587,69 @@ static void define_variable(Byte global)
  */
 static void named_variable(Token name, bool can_assign)
 {
-  Byte get_op, set_op;
+  Byte get_op, set_op, get_op_long, set_op_long;
   int arg = resolve_local(current, &name, false);
   if(arg != -1)
   {
-    get_op = OP_GET_LOCAL;
-    set_op = OP_SET_LOCAL;
+    get_op      = OP_GET_LOCAL;
+    set_op      = OP_SET_LOCAL;
+    get_op_long = OP_GET_LOCAL_LONG;
+    set_op_long = OP_SET_LOCAL_LONG;
   }
   else
   {
-    arg = identifier_constant(&name);
-    get_op = OP_GET_GLOBAL;
-    set_op = OP_SET_GLOBAL;
+    arg = global_slot(&name);
+    get_op      = OP_GET_GLOBAL;
+    set_op      = OP_SET_GLOBAL;
+    get_op_long = OP_GET_GLOBAL_LONG;
+    set_op_long = OP_SET_GLOBAL_LONG;
   }
 
   if(can_assign && match(TOKEN_EQUAL))
   {
     expression();
-    emit_bytes(set_op, arg);
+    emit_indexed(set_op, set_op_long, arg);
   }
   else
   {
-    emit_bytes(get_op, arg);
+    emit_indexed(get_op, get_op_long, arg);
   }
 }
 
-/** @brief Create a constant for the identifier token.
+/** @brief Resolve an identifier to its global slot.
  *
- * Create a constant for the identifier and return the index
- * to the constant.
+ * Look the identifier up in the VM's global name table and return its
+ * slot index, allocating a fresh slot the first time a name is seen.
+ * The slot is resolved once here at compile time, so the VM indexes
+ * straight into the globals array with no hashing at run time.
  *
- * @param token The identifier token to turn into a constant.
- * @return The constant index for the identifier.
+ * @param token The identifier token to resolve.
+ * @return The global slot index for the identifier.
  */
-static Byte identifier_constant(Token *token)
+static int global_slot(Token *token)
 {
-  return make_constant(AS_OBJECT(copy_string(token->lexeme, strlen(token->lexeme))));
+  ObjectString *name = copy_string(token->lexeme, strlen(token->lexeme));
+
+  VM *vm = vm_active();
+  Value *existing = table_search(vm->globals, create_object((Object*)name));
+  if(existing != NULL)
+    return (int)AS_INTEGER(*existing);
+
+  // The wide opcode forms index slots with sixteen bits.
+  if(vm->global_slots.count > UINT16_MAX)
+  {
+    error(token, "Too many global variables.");
+    return 0;
+  }
+
+  // Root the name while the slot array and name table grow, since
+  // either allocation can trigger a collection.
+  push(vm, create_object((Object*)name));
+  write_value_array(&vm->global_slots, create_undefined());
+  table_insert(vm->globals, create_object((Object*)name), create_integer(vm->global_slots.count - 1));
+  pop(vm);
+
+  return vm->global_slots.count - 1;
 }
 
 /** @brief Get the currently compiling Chunk.
@@ -1349,6 +1671,13 @@ static Chunk *current_chunk()
  */
 static void emit_byte(Byte byte)
 {
+  // Any byte written here breaks whatever pattern the peephole stage
+  // was tracking. The emitters that produce fusable instructions
+  // re-arm the trackers after the write.
+  fusable_constant      = -1;
+  fusable_constant_prev = -1;
+  fusable_compare       = -1;
+
   write_chunk(current_chunk(), byte, parser.previous.line);
 }
 
@@ -1419,6 +1748,12 @@ static void patch_jump(int offset)
 
   current_chunk()->code[offset] = (jump >> 8) & 0xff;
   current_chunk()->code[offset + 1] = jump & 0xff;
+
+  // The end of the chunk is now a jump target, so the last instruction
+  // must not be rewritten into a longer fused form.
+  fusable_constant      = -1;
+  fusable_constant_prev = -1;
+  fusable_compare       = -1;
 }
 
 /** @brief End compilation and emit a return operation.
@@ -1429,36 +1764,96 @@ static void patch_jump(int offset)
 static void end_compiler()
 {
   emit_return();
+
+  FREE_ARRAY(Local, current->locals, current->local_capacity);
+  current->locals = NULL;
+  current->local_count = 0;
+  current->local_capacity = 0;
 }
 
-/** @brief Emit an object constant operation.
+/** @brief Emit a constant operation.
  *
- * Add the byte codes to access an object to the Chunk array.
+ * Add the byte codes to access a constant value to the Chunk array.
  *
- * @param object The object constant to reference.
+ * @param value The constant value to reference.
  */
-static void emit_constant(Object *object)
+static void emit_constant(Value value)
 {
-  emit_bytes(OP_CONSTANT, make_constant(object));
+  // When the previous instruction is also a plain OP_CONSTANT the new
+  // pair is a literal expression the folder can evaluate.
+  int previous = fusable_constant;
+
+  int index = make_constant(value);
+  if(index <= UINT8_MAX)
+  {
+    emit_bytes(OP_CONSTANT, (Byte)index);
+
+    // This constant is now the latest instruction, so a following
+    // operator can fuse with it.
+    fusable_constant      = current_chunk()->count - 2;
+    fusable_constant_prev = previous;
+    return;
+  }
+
+  // The peephole stage only fuses the one byte form.
+  emit_byte(OP_CONSTANT_LONG);
+  emit_byte((Byte)((index >> 16) & 0xff));
+  emit_byte((Byte)((index >> 8) & 0xff));
+  emit_byte((Byte)(index & 0xff));
 }
 
-/** @brief Make a new object.
+/** @brief Make a new constant.
  *
- * Add an object to the list of constants in the Chunk.
+ * Add a value to the list of constants in the Chunk.
  *
- * @param object The object to make.
- * @return The index to the object in the Chunk.
+ * @param value The value to make a constant for.
+ * @return The index to the value in the Chunk.
  */
-static Byte make_constant(Object *object)
+static int make_constant(Value value)
 {
-  int index = add_constant(current_chunk(), object);
-  if(index > UINT8_MAX)
+  // Reuse the slot of an identical constant added earlier. The map is
+  // keyed by value, so `0` or "status" mentioned five hundred times
+  // still occupies a single slot in the constants array.
+  Value *existing = table_search(&constant_indexes, value);
+  if(existing != NULL)
+    return (int)AS_INTEGER(*existing);
+
+  int index = add_constant(current_chunk(), value);
+
+  // The wide opcode form indexes constants with twenty four bits.
+  if(index > 0xffffff)
   {
     error(&parser.previous, "Too many constants in one chunk.");
     return 0;
   }
 
-  return (Byte)index;
+  // The value is rooted in the chunk constants by now, so the insert
+  // below is safe even if growing the map triggers a collection.
+  table_insert(&constant_indexes, value, create_integer(index));
+
+  return index;
+}
+
+/** @brief Emit an instruction with a one or two byte index operand.
+ *
+ * Uses the single byte opcode when the index fits, otherwise the wide
+ * form with the index in two big endian bytes.
+ *
+ * @param op The opcode with a one byte operand.
+ * @param op_long The opcode with a two byte operand.
+ * @param index The index operand.
+ */
+static void emit_indexed(Byte op, Byte op_long, int index)
+{
+  if(index <= UINT8_MAX)
+  {
+    emit_bytes(op, (Byte)index);
+    return;
+  }
+
+  emit_byte(op_long);
+  emit_byte((Byte)((index >> 8) & 0xff));
+  emit_byte((Byte)(index & 0xff));
 }
 
 /** @brief Emit a return byte code.
@@ -1470,6 +1865,283 @@ static void emit_return()
   emit_byte(OP_RETURN);
 }
 
+/** @brief Fuse a trailing OP_CONSTANT into a superinstruction.
+ *
+ * When the most recently emitted instruction is an OP_CONSTANT, its
+ * opcode byte is rewritten in place to the fused opcode, which keeps
+ * the constant index operand and absorbs the operator that was about
+ * to be emitted.
+ *
+ * @param fused The superinstruction to rewrite the OP_CONSTANT to.
+ * @return True if the fusion happened, false if the operator must be emitted as usual.
+ */
+static bool fuse_constant_operand(Byte fused)
+{
+  if(fusable_constant == -1)
+    return false;
+
+  current_chunk()->code[fusable_constant] = fused;
+
+  // A fused comparison can itself fuse with a conditional jump.
+  if(fused == OP_LESS_CONST || fused == OP_GREATER_CONST)
+    fusable_compare = fusable_constant;
+
+  fusable_constant = -1;
+  return true;
+}
+
+/** @brief Fold an operator over trailing literal operands.
+ *
+ * When the last one or two instructions push literal constants, the
+ * operator that was about to be emitted is evaluated at compile time
+ * instead. The literal pushes are removed from the chunk and replaced
+ * with a single constant, or with OP_TRUE / OP_FALSE for comparison
+ * results, which compile to dedicated opcodes rather than constants.
+ *
+ * @param type The operator token about to be emitted.
+ * @return True if the expression was folded, false if the operator must be emitted as usual.
+ */
+static bool fold_binary(TokenType type)
+{
+  if(fusable_constant == -1 || fusable_constant_prev == -1)
+    return false;
+
+  Chunk *chunk = current_chunk();
+  Value a = chunk->constants.values[chunk->code[fusable_constant_prev + 1]];
+  Value b = chunk->constants.values[chunk->code[fusable_constant + 1]];
+  int start = fusable_constant_prev;
+
+  // Equality is defined for every pair of values.
+  if(type == TOKEN_EQUAL_EQUAL || type == TOKEN_BANG_EQUAL)
+  {
+    bool equal = values_equal(a, b);
+    if(type == TOKEN_BANG_EQUAL)
+      equal = !equal;
+    rewind_chunk(start);
+    emit_byte(equal ? OP_TRUE : OP_FALSE);
+    return true;
+  }
+
+  // Two literal strings joined with + fold to one interned string.
+  // The operands stay rooted in the constants array while the result
+  // is built.
+  if(type == TOKEN_PLUS && IS_STRING(a) && IS_STRING(b))
+  {
+    Value pair[2] = { a, b };
+    Value joined = create_object((Object*)concat_strings(pair, 2));
+    rewind_chunk(start);
+    emit_constant(joined);
+    return true;
+  }
+
+  if(!IS_NUMBER(a) || !IS_NUMBER(b))
+    return false;
+
+  // Integer operands fold with integer arithmetic, anything else
+  // promotes to a real, matching what the VM would compute.
+  if(IS_INTEGER(a) && IS_INTEGER(b))
+  {
+    long left  = AS_INTEGER(a);
+    long right = AS_INTEGER(b);
+
+    Value folded;
+    switch(type)
+    {
+      case TOKEN_PLUS:    folded = create_integer(left + right); break;
+      case TOKEN_MINUS:   folded = create_integer(left - right); break;
+      case TOKEN_STAR:    folded = create_integer(left * right); break;
+      case TOKEN_CARET:   folded = create_integer(pow((double)left, (double)right)); break;
+      case TOKEN_SLASH:
+      case TOKEN_PERCENT:
+        // Division by zero stays in the code so it still fails at
+        // runtime the way the VM reports it.
+        if(right == 0)
+          return false;
+        folded = type == TOKEN_SLASH ? create_integer(left / right)
+                                     : create_integer(left % right);
+        break;
+      case TOKEN_GREATER:
+      case TOKEN_GREATER_EQUAL:
+      case TOKEN_LESS:
+      case TOKEN_LESS_EQUAL:
+      {
+        bool result = type == TOKEN_GREATER       ? left > right
+                    : type == TOKEN_GREATER_EQUAL ? !(left < right)
+                    : type == TOKEN_LESS          ? left < right
+                    : !(left > right);
+        rewind_chunk(start);
+        emit_byte(result ? OP_TRUE : OP_FALSE);
+        return true;
+      }
+      default:
+        return false;
+    }
+
+    rewind_chunk(start);
+    emit_constant(folded);
+    return true;
+  }
+
+  double left  = IS_REAL(a) ? AS_REAL(a) : (double)AS_INTEGER(a);
+  double right = IS_REAL(b) ? AS_REAL(b) : (double)AS_INTEGER(b);
+
+  Value folded;
+  switch(type)
+  {
+    case TOKEN_PLUS:  folded = create_real(left + right); break;
+    case TOKEN_MINUS: folded = create_real(left - right); break;
+    case TOKEN_STAR:  folded = create_real(left * right); break;
+    case TOKEN_CARET: folded = create_real(pow(left, right)); break;
+    case TOKEN_SLASH:
+      if(right == 0)
+        return false;
+      folded = create_real(left / right);
+      break;
+    case TOKEN_GREATER:
+    case TOKEN_GREATER_EQUAL:
+    case TOKEN_LESS:
+    case TOKEN_LESS_EQUAL:
+    {
+      bool result = type == TOKEN_GREATER       ? left > right
+                  : type == TOKEN_GREATER_EQUAL ? !(left < right)
+                  : type == TOKEN_LESS          ? left < right
+                  : !(left > right);
+      rewind_chunk(start);
+      emit_byte(result ? OP_TRUE : OP_FALSE);
+      return true;
+    }
+    default:
+      // The modulus operator only accepts integers.
+      return false;
+  }
+
+  rewind_chunk(start);
+  emit_constant(folded);
+  return true;
+}
+
+/** @brief Fold a unary operator over a trailing literal operand.
+ *
+ * @param type The operator token about to be emitted.
+ * @return True if the expression was folded, false if the operator must be emitted as usual.
+ */
+static bool fold_unary(TokenType type)
+{
+  if(fusable_constant == -1)
+    return false;
+
+  Chunk *chunk = current_chunk();
+  Value operand = chunk->constants.values[chunk->code[fusable_constant + 1]];
+  int start = fusable_constant;
+
+  switch(type)
+  {
+    case TOKEN_MINUS:
+      if(IS_INTEGER(operand))
+      {
+        long integer = AS_INTEGER(operand);
+        rewind_chunk(start);
+        emit_constant(create_integer(-integer));
+        return true;
+      }
+      if(IS_REAL(operand))
+      {
+        double real = AS_REAL(operand);
+        rewind_chunk(start);
+        emit_constant(create_real(-real));
+        return true;
+      }
+      return false;
+    case TOKEN_BANG:
+      // Only nil and false are falsey, and neither is ever stored as a
+      // constant, so `!` on a literal is always false.
+      rewind_chunk(start);
+      emit_byte(OP_FALSE);
+      return true;
+    default:
+      return false;
+  }
+}
+
+/** @brief Remove trailing literal pushes from the chunk.
+ *
+ * Truncates the bytecode back to the given offset, trimming the line
+ * table to match, so the folder can replace literal pushes with their
+ * computed result.
+ *
+ * @param offset The chunk offset to truncate back to.
+ */
+static void rewind_chunk(int offset)
+{
+  Chunk *chunk = current_chunk();
+  int remove = chunk->count - offset;
+  chunk->count = offset;
+
+  while(remove > 0)
+  {
+    LineRun *run = &chunk->lines[chunk->line_count - 1];
+    if(run->count > remove)
+    {
+      run->count -= remove;
+      remove = 0;
+    }
+    else
+    {
+      remove -= run->count;
+      chunk->line_count--;
+    }
+  }
+
+  fusable_constant      = -1;
+  fusable_constant_prev = -1;
+  fusable_compare       = -1;
+}
+
+/** @brief Fuse a trailing comparison into a conditional exit jump.
+ *
+ * When the condition of an if or while statement ends in a comparison
+ * instruction, the comparison is rewritten in place to a fused
+ * compare-and-branch opcode and the jump offset placeholder is
+ * appended to it. The fused opcodes consume their operands, so the
+ * caller must not emit the usual OP_POPs for the condition value.
+ *
+ * @param jump_offset Receives the offset of the jump placeholder, as emit_jump would return.
+ * @return True if the fusion happened, false if an OP_JUMP_IF_FALSE must be emitted as usual.
+ */
+static bool fuse_compare_jump(int *jump_offset)
+{
+  if(fusable_compare == -1)
+    return false;
+
+  Chunk *chunk = current_chunk();
+
+  Byte fused;
+  switch(chunk->code[fusable_compare])
+  {
+    case OP_LESS:
+      fused = OP_JUMP_IF_NOT_LESS;
+      break;
+    case OP_GREATER:
+      fused = OP_JUMP_IF_NOT_GREATER;
+      break;
+    case OP_LESS_CONST:
+      fused = OP_JUMP_IF_NOT_LESS_CONST;
+      break;
+    case OP_GREATER_CONST:
+      fused = OP_JUMP_IF_NOT_GREATER_CONST;
+      break;
+    default:
+      return false;
+  }
+
+  chunk->code[fusable_compare] = fused;
+  emit_byte(0xff);
+  emit_byte(0xff);
+
+  *jump_offset = chunk->count - 2;
+  return true;
+}
+
 /** @brief Wrapper for the parse_error function.
  *
  * Send the token and error message along to parse_error and
@@ -1507,6 +2179,7 @@ static void synchronize()
       case TOKEN_CLASS:
       case TOKEN_DEF:
       case TOKEN_IF:
+      case TOKEN_IMPORT:
       case TOKEN_WHILE:
       case TOKEN_RETURN:
         return;
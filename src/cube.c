@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "common.h"
+#include "cache.h"
 #include "chunk.h"
 #include "debug.h"
 #include "vm.h"
@@ -35,7 +36,7 @@
  *
  * @return The result of the source code interpretation.
  */
-static int repl();
+static int repl(VM *vm);
 
 /** @brief Process the source code file at `file_path`.
  *
@@ -44,7 +45,21 @@ static int repl();
  *
  * @return The result of the source code interpretation.
  */
-static int run_file(const char *file_path);
+static int run_file(VM *vm, const char *file_path);
+
+/** The source size in bytes above which a script is compiled and
+ * executed in streamed batches instead of as one chunk, so a large
+ * script starts producing output before the compiler reaches the end
+ * of the source. Below it a script compiles in a blink and the single
+ * chunk path keeps the bytecode cache. */
+#define STREAM_THRESHOLD (64 * 1024)
+
+/** @brief The size of the file at `file_path` in bytes.
+ *
+ * @param file_path The file to measure.
+ * @return The file size, or 0 when the file cannot be opened.
+ */
+static long file_size(const char *file_path);
 
 /** @brief The main function for Cube.
  *
@@ -62,19 +77,20 @@ int main(int argc, char *argv[])
 
   int result = 0;
 
-  vm_init(options);
+  VM vm;
+  vm_init(&vm, options);
 
   if(options_get_script(options) == NULL)
   {
-    result = repl();
+    result = repl(&vm);
   }
   else
   {
-    result = run_file(options_get_script(options));
+    result = run_file(&vm, options_get_script(options));
   }
 
   options_free(options);
-  vm_free();
+  vm_free(&vm);
 
   return result;
 }
@@ -92,10 +108,16 @@ int main(int argc, char *argv[])
  *
  * @return The result of the source code interpretation.
  */
-static int repl()
+static int repl(VM *vm)
 {
   InterpretResult result = INTERPRET_OK;
 
+  // One chunk serves the whole session. Each line resets it but keeps
+  // its capacity and constants, so trivial lines compile and run
+  // without allocating or freeing the chunk arrays.
+  Chunk chunk;
+  init_chunk(&chunk);
+
   static char *line = (char *)NULL;
   for(;;)
   {
@@ -112,7 +134,7 @@ static int repl()
       if(strcmp(line, "exit") == 0)
       {
         // Exit from the REPL.
-        return result;
+        break;
       }
 
       // Not exiting, add the line to history.
@@ -120,9 +142,14 @@ static int repl()
     }
 
     add_source_line(line);
-    result = interpret();
+    result = interpret_line(vm, &chunk);
   }
 
+  // The VM kept the pooled chunk rooted between lines; detach it
+  // before the storage goes away with this frame.
+  vm->chunk = NULL;
+  free_chunk(&chunk);
+
   return result;
 }
 
@@ -133,8 +160,45 @@ static int repl()
  *
  * @return The result of the source code interpretation.
  */
-static int run_file(const char *file_path)
+static int run_file(VM *vm, const char *file_path)
 {
+  // A warm start: when a valid bytecode cache sits next to the script
+  // the scanner and compiler are skipped entirely.
+  Chunk chunk;
+  init_chunk(&chunk);
+  if(cache_load(vm, file_path, &chunk))
+  {
+    InterpretResult result = interpret_chunk(vm, &chunk);
+    free_chunk(&chunk);
+    return result;
+  }
+
   add_source_file(file_path);
-  return interpret();
+
+  // A script too large to compile in a blink streams instead, running
+  // each batch of declarations while the rest is still source. A
+  // streamed run is never cached: its bytecode never exists as one
+  // chunk, and at this size the compile is a small share of the run.
+  if(file_size(file_path) > STREAM_THRESHOLD)
+    return interpret_stream(vm);
+
+  return interpret(vm);
+}
+
+/** @brief The size of the file at `file_path` in bytes.
+ *
+ * @param file_path The file to measure.
+ * @return The file size, or 0 when the file cannot be opened.
+ */
+static long file_size(const char *file_path)
+{
+  FILE *file = fopen(file_path, "r");
+  if(file == NULL)
+    return 0;
+
+  fseek(file, 0L, SEEK_END);
+  long size = ftell(file);
+  fclose(file);
+
+  return size;
 }
@@ -18,6 +18,9 @@ static int simple_instruction(const char *name, int offset);
 static int byte_instruction(const char *name, Chunk *chunk, int offset);
 static int constant_instruction(const char *name, Chunk *chunk, int offset);
 static int jump_instruction(const char *name, int sign, Chunk *chunk, int offset);
+static int constant_jump_instruction(const char *name, Chunk *chunk, int offset);
+static int short_instruction(const char *name, Chunk *chunk, int offset);
+static int constant_long_instruction(const char *name, Chunk *chunk, int offset);
 
 /** @brief Disassemble the entire Chunk array of code.
  *
@@ -50,13 +53,13 @@ int disassemble_instruction(Chunk *chunk, int offset)
 {
   printf("%04d ", offset);
 
-  if(offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1])
+  if(offset > 0 && chunk_get_line(chunk, offset) == chunk_get_line(chunk, offset - 1))
   {
     printf("   | ");
   }
   else
   {
-    printf("%4d ", chunk->lines[offset]);
+    printf("%4d ", chunk_get_line(chunk, offset));
   }
 
   uint8_t instruction = chunk->code[offset];
@@ -66,6 +69,10 @@ int disassemble_instruction(Chunk *chunk, int offset)
       return constant_instruction("OP_CONSTANT", chunk, offset);
     case OP_NIL:
       return simple_instruction("OP_NIL", offset);
+    case OP_TRUE:
+      return simple_instruction("OP_TRUE", offset);
+    case OP_FALSE:
+      return simple_instruction("OP_FALSE", offset);
     case OP_POP:
       return simple_instruction("OP_POP", offset);
     case OP_GET_LOCAL:
@@ -73,11 +80,11 @@ int disassemble_instruction(Chunk *chunk, int offset)
     case OP_SET_LOCAL:
       return byte_instruction("OP_SET_LOCAL", chunk, offset);
     case OP_GET_GLOBAL:
-      return constant_instruction("OP_GET_GLOBAL", chunk, offset);
+      return byte_instruction("OP_GET_GLOBAL", chunk, offset);
     case OP_DEFINE_GLOBAL:
-      return constant_instruction("OP_DEFINE_GLOBAL", chunk, offset);
+      return byte_instruction("OP_DEFINE_GLOBAL", chunk, offset);
     case OP_SET_GLOBAL:
-      return constant_instruction("OP_SET_GLOBAL", chunk, offset);
+      return byte_instruction("OP_SET_GLOBAL", chunk, offset);
     case OP_EQUAL:
       return simple_instruction("OP_EQUAL", offset);
     case OP_GREATER:
@@ -108,6 +115,50 @@ int disassemble_instruction(Chunk *chunk, int offset)
       return jump_instruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
     case OP_LOOP:
       return jump_instruction("OP_LOOP", -1, chunk, offset);
+    case OP_ADD_CONST:
+      return constant_instruction("OP_ADD_CONST", chunk, offset);
+    case OP_SUBTRACT_CONST:
+      return constant_instruction("OP_SUBTRACT_CONST", chunk, offset);
+    case OP_LESS_CONST:
+      return constant_instruction("OP_LESS_CONST", chunk, offset);
+    case OP_GREATER_CONST:
+      return constant_instruction("OP_GREATER_CONST", chunk, offset);
+    case OP_JUMP_IF_NOT_LESS:
+      return jump_instruction("OP_JUMP_IF_NOT_LESS", 1, chunk, offset);
+    case OP_JUMP_IF_NOT_GREATER:
+      return jump_instruction("OP_JUMP_IF_NOT_GREATER", 1, chunk, offset);
+    case OP_JUMP_IF_NOT_LESS_CONST:
+      return constant_jump_instruction("OP_JUMP_IF_NOT_LESS_CONST", chunk, offset);
+    case OP_JUMP_IF_NOT_GREATER_CONST:
+      return constant_jump_instruction("OP_JUMP_IF_NOT_GREATER_CONST", chunk, offset);
+    case OP_ADD_INT:
+      return simple_instruction("OP_ADD_INT", offset);
+    case OP_ADD_REAL:
+      return simple_instruction("OP_ADD_REAL", offset);
+    case OP_SUBTRACT_INT:
+      return simple_instruction("OP_SUBTRACT_INT", offset);
+    case OP_SUBTRACT_REAL:
+      return simple_instruction("OP_SUBTRACT_REAL", offset);
+    case OP_MULTIPLY_INT:
+      return simple_instruction("OP_MULTIPLY_INT", offset);
+    case OP_MULTIPLY_REAL:
+      return simple_instruction("OP_MULTIPLY_REAL", offset);
+    case OP_CONCAT_N:
+      return byte_instruction("OP_CONCAT_N", chunk, offset);
+    case OP_CONSTANT_LONG:
+      return constant_long_instruction("OP_CONSTANT_LONG", chunk, offset);
+    case OP_GET_LOCAL_LONG:
+      return short_instruction("OP_GET_LOCAL_LONG", chunk, offset);
+    case OP_SET_LOCAL_LONG:
+      return short_instruction("OP_SET_LOCAL_LONG", chunk, offset);
+    case OP_GET_GLOBAL_LONG:
+      return short_instruction("OP_GET_GLOBAL_LONG", chunk, offset);
+    case OP_DEFINE_GLOBAL_LONG:
+      return short_instruction("OP_DEFINE_GLOBAL_LONG", chunk, offset);
+    case OP_SET_GLOBAL_LONG:
+      return short_instruction("OP_SET_GLOBAL_LONG", chunk, offset);
+    case OP_IMPORT:
+      return simple_instruction("OP_IMPORT", offset);
     case OP_RETURN:
       return simple_instruction("OP_RETURN", offset);
     default:
@@ -162,7 +213,7 @@ static int constant_instruction(const char *name, Chunk *chunk, int offset)
 {
   uint8_t constant = chunk->code[offset + 1];
   printf("%-16s %4d '", name, constant);
-  print_object(chunk->constants.objects[constant]);
+  print_value(chunk->constants.values[constant]);
   printf("'\n");
   return offset + 2;
 }
@@ -184,3 +235,63 @@ static int jump_instruction(const char *name, int sign, Chunk *chunk, int offset
   printf("%-16s %4d -> %d\n", name, offset, offset + 3 + sign * jump);
   return offset + 3;
 }
+
+/** @brief Output a fused compare-and-branch instruction.
+ *
+ * The fused conditional jumps carry a constant index operand followed
+ * by a 16 bit forward jump offset.
+ *
+ * @param name The bytecode instruction name.
+ * @param chunk The Chunk array gives access to the code and constants.
+ * @param offset The current offset into the Chunk array for this instruction.
+ * @return The new offset for the next bytecode instruction.
+ */
+static int constant_jump_instruction(const char *name, Chunk *chunk, int offset)
+{
+  uint8_t constant = chunk->code[offset + 1];
+  uint16_t jump = (uint16_t)(chunk->code[offset + 2] << 8);
+  jump |= chunk->code[offset + 3];
+  printf("%-16s %4d '", name, constant);
+  print_value(chunk->constants.values[constant]);
+  printf("' -> %d\n", offset + 4 + jump);
+  return offset + 4;
+}
+
+/** @brief Output an instruction with a 16 bit slot operand.
+ *
+ * The wide local and global forms carry their slot index in two
+ * big endian bytes.
+ *
+ * @param name The bytecode instruction name.
+ * @param chunk The Chunk array gives access to the code.
+ * @param offset The current offset into the Chunk array for this instruction.
+ * @return The new offset for the next bytecode instruction.
+ */
+static int short_instruction(const char *name, Chunk *chunk, int offset)
+{
+  uint16_t slot = (uint16_t)(chunk->code[offset + 1] << 8);
+  slot |= chunk->code[offset + 2];
+  printf("%-16s %4d\n", name, slot);
+  return offset + 3;
+}
+
+/** @brief Output a long constant instruction.
+ *
+ * OP_CONSTANT_LONG carries its constant index in three big endian
+ * bytes.
+ *
+ * @param name The bytecode instruction name.
+ * @param chunk The Chunk array gives access to the ValueArray of constants.
+ * @param offset The current offset into the Chunk array for this instruction.
+ * @return The new offset for the next bytecode instruction.
+ */
+static int constant_long_instruction(const char *name, Chunk *chunk, int offset)
+{
+  int constant = (chunk->code[offset + 1] << 16)
+               | (chunk->code[offset + 2] << 8)
+               |  chunk->code[offset + 3];
+  printf("%-16s %4d '", name, constant);
+  print_value(chunk->constants.values[constant]);
+  printf("'\n");
+  return offset + 4;
+}
@@ -15,71 +15,50 @@
  */
 typedef struct
 {
-  int token_type; /**< Store the TokenType enumeration value. */
-  int hash;       /**< Store the pre-calculated hash value for this keyword. */
-  char *word;     /**< The string value of the keyword. */
+  int token_type;   /**< Store the TokenType enumeration value. */
+  int length;       /**< The length of the keyword. */
+  const char *word; /**< The string value of the keyword. */
 } Keyword;
 
-/** @brief The keywords array is an array of Keyword structs for each Cube keyword.
- */
-Keyword keywords[] = {
-  { TOKEN_BEGIN,  2504, "begin"  },
-  { TOKEN_BREAK,  3748, "break"  },
-  { TOKEN_CASE,   3481, "case"   },
-  { TOKEN_CLASS,  1018, "class"  },
-  { TOKEN_DEF,    4235, "def"    },
-  { TOKEN_DO,     2081, "do"     },
-  { TOKEN_ELSE,   1128, "else"   },
-  { TOKEN_END,    7082, "end"    },
-  { TOKEN_ENSURE, 7205, "ensure" },
-  { TOKEN_FALSE,  2595, "false"  },
-  { TOKEN_IF,     6130, "if"     },
-  { TOKEN_NEXT,   1643, "next"   },
-  { TOKEN_NIL,    4493, "nil"    },
-  { TOKEN_PRINT,  7156, "print"  },
-  { TOKEN_RESCUE, 7137, "rescue" },
-  { TOKEN_RETURN, 2618, "return" },
-  { TOKEN_SUPER,  4786, "super"  },
-  { TOKEN_SWITCH, 5077, "switch" },
-  { TOKEN_THIS,   5937, "this"   },
-  { TOKEN_TRUE,   749,  "true"   },
-  { TOKEN_UNLESS, 7846, "unless" },
-  { TOKEN_UNTIL,  1255, "until"  },
-  { TOKEN_VAR,    5443, "var"    },
-  { TOKEN_WHILE,  6530, "while"  },
-};
-
-/** @brief Generate a hash value for the given string.
- *
- * Uses the universal string hash from (Algorithms in C)[https://www.amazon.com/Algorithms-Parts-1-4-Fundamentals-Structures/dp/0201314525].
- * Generates a hash value between 0 and HASH_MAX for the given word.
- *
- * @param word A string to generate a hash value for.
- * @return The generated hash value.
- */
-static int hash(const char *word);
+/* Generated by tools/kw2hash. Do not edit by hand. */
+#define KEYWORD_TABLE_SIZE 42
+#define KEYWORD_MULT_FIRST 31
+#define KEYWORD_MULT_LAST  10
 
-/** @brief Verify that the input word is actually a keyword.
- *
- * If the passed in words hash value matches one of the keyword
- * hash values we can't be positive that word is actually a keyword.
- * There could be hash collisions. This function does a comparison
- * of word and the suspected keyword. If they do indeed match
- * the TokenType for the keyword is returned. Otherwise it wasn't
- * actually a keyword and zero is returned.
- *
- * @param word A string to verify against a keyword.
- * @param index The index into the keywords array that has a matching hash value as word.
- * @return The TokenType of the keyword if they match, otherwise zero.
- */
-static int verify_keyword(const char *word, int index);
+static const Keyword keywords[KEYWORD_TABLE_SIZE] = {
+  [27] = { TOKEN_BEGIN, 5, "begin" },
+  [39] = { TOKEN_BREAK, 5, "break" },
+  [ 9] = { TOKEN_CASE, 4, "case" },
+  [24] = { TOKEN_CLASS, 5, "class" },
+  [ 7] = { TOKEN_DEF, 3, "def" },
+  [12] = { TOKEN_DO, 2, "do" },
+  [29] = { TOKEN_ELSE, 4, "else" },
+  [18] = { TOKEN_END, 3, "end" },
+  [31] = { TOKEN_ENSURE, 6, "ensure" },
+  [19] = { TOKEN_FALSE, 5, "false" },
+  [35] = { TOKEN_IF, 2, "if" },
+  [11] = { TOKEN_IMPORT, 6, "import" },
+  [38] = { TOKEN_NEXT, 4, "next" },
+  [41] = { TOKEN_NIL, 3, "nil" },
+  [17] = { TOKEN_PRINT, 5, "print" },
+  [14] = { TOKEN_RESCUE, 6, "rescue" },
+  [20] = { TOKEN_RETURN, 6, "return" },
+  [ 6] = { TOKEN_SUPER, 5, "super" },
+  [33] = { TOKEN_SWITCH, 6, "switch" },
+  [ 4] = { TOKEN_THIS, 4, "this" },
+  [32] = { TOKEN_TRUE, 4, "true" },
+  [37] = { TOKEN_UNLESS, 6, "unless" },
+  [ 8] = { TOKEN_UNTIL, 5, "until" },
+  [13] = { TOKEN_VAR, 3, "var" },
+  [ 0] = { TOKEN_WHILE, 5, "while" },
+};
 
 /** @brief Find a keyword that matches the input word.
  *
- * Will generate a hash value for the input word and
- * check against the Cube keyword hash values. If there
- * is a match a further verification check is performed
- * to prevent false positives in the case of a hash collision.
+ * Indexes the perfect hash table generated by tools/kw2hash with a
+ * slot computed from the first character, last character and length
+ * of the word. Every keyword owns its own slot, so one memcmp against
+ * the slot entry settles the classification.
  *
  * If word is NULL or zero length, or if word is longer than
  * any of the existing Cube keywords the function returns zero.
@@ -93,32 +72,18 @@ int find_keyword(const char *word)
   if(word == NULL)
     return 0;
 
-  // Can't be a keyword if it is 0 characters or greather than 6 characters.
-  int length = strnlen(word, MAX_KEYWORD_LEN);
-  if(length < 1 || length > 6)
+  // Can't be a keyword if it is shorter or longer than every keyword.
+  int length = (int)strnlen(word, MAX_KEYWORD_LEN);
+  if(length < 2 || length > 6)
     return 0;
 
-  int value = hash(word);
-  for(int i = 0; i < NUM_KEYWORDS; i++)
-  {
-    if(keywords[i].hash == value)
-      return verify_keyword(word, i);
-  }
-  return false;
-}
+  int slot = (KEYWORD_MULT_FIRST * word[0]
+            + KEYWORD_MULT_LAST * word[length - 1]
+            + length) % KEYWORD_TABLE_SIZE;
 
-static int hash(const char *word)
-{
-  int h, a = 31415, b = 27183;
-  for(h = 0; *word != '\0'; word++, a = a * b % (HASH_MAX - 1))
-    h = (a * h + *word) % HASH_MAX;
+  const Keyword *keyword = &keywords[slot];
+  if(keyword->length == length && memcmp(word, keyword->word, length) == 0)
+    return keyword->token_type;
 
-  return h;
-}
-
-static int verify_keyword(const char *word, int index)
-{
-  if(memcmp(word, keywords[index].word, strnlen(keywords[index].word, MAX_KEYWORD_LEN)) == 0)
-    return keywords[index].token_type;
   return 0;
 }
@@ -6,9 +6,133 @@
  * @bug No known bugs.
  */
 #include "config.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "common.h"
 #include "memory.h"
+#include "object.h"
+#include "table.h"
+#include "vm.h"
+
+/** After a collection the next threshold is the surviving byte count times this factor. */
+#define GC_HEAP_GROW_FACTOR 2
+
+/** Arena allocations are rounded up to a multiple of this alignment. */
+#define ARENA_ALIGN 8
+
+/** The default capacity of an arena page. */
+#define ARENA_PAGE_SIZE (16 * 1024)
+
+/** An arena page. Allocations are bumped out of data until it runs out. */
+typedef struct arena_page {
+  struct arena_page *next;  /**< The next (older) page in the arena. */
+  size_t capacity;          /**< The usable size of data. */
+  size_t used;              /**< How much of data has been handed out. */
+  char *data;               /**< The page memory itself. */
+} ArenaPage;
+
+/** The list of arena pages, newest first. */
+static __thread ArenaPage *arena_pages = NULL;
+
+/** The most allocation sites the memory profiler tracks. Sites past
+ * the limit are folded into a single overflow row. */
+#define MEMORY_SITES_MAX 128
+
+/** One allocation site, aggregated by the file and line that the
+ * NEW/ALLOC/GROW_ARRAY macros capture at their expansion point. */
+typedef struct {
+  const char *file;       /**< The source file of the reallocate call. */
+  int line;               /**< The source line of the reallocate call. */
+  uint64_t count;         /**< How many allocations this site has made. */
+  size_t total_bytes;     /**< Cumulative bytes this site has requested. */
+  size_t live_bytes;      /**< Bytes from this site still allocated. */
+} MemorySite;
+
+/** One live allocation, mapping a pointer back to its site so a free
+ * or resize issued from a different site credits the right row. */
+typedef struct {
+  void *pointer;          /**< The allocated pointer, NULL for an empty slot. */
+  int site;               /**< Index into memory_sites, -1 for a removed slot. */
+  size_t size;            /**< The size of the allocation. */
+} MemoryBlock;
+
+/** Is the allocation-site profiler recording? Off by default, so the
+ * only cost on the normal path is one predictable branch per call. */
+static __thread bool memory_profiling = false;
+
+/** The allocation sites seen so far. */
+static __thread MemorySite memory_sites[MEMORY_SITES_MAX];
+
+/** The number of memory_sites rows in use. */
+static __thread int memory_site_count = 0;
+
+/** Open addressed map from live pointer to its allocation record.
+ * The profiler's own storage comes straight from malloc so it never
+ * shows up in the numbers it reports. */
+static __thread MemoryBlock *memory_blocks = NULL;
+
+/** The capacity of the memory_blocks map, always a power of two. */
+static __thread int memory_block_capacity = 0;
+
+/** The number of live entries in the memory_blocks map. */
+static __thread int memory_block_count = 0;
+
+/** The bytes currently allocated while profiling. */
+static __thread size_t memory_live = 0;
+
+/** The heap high-water mark: the largest memory_live seen. */
+static __thread size_t memory_peak = 0;
+
+/** @brief Mark a single value as reachable.
+ *
+ * Immediate values carry no heap data, so only Object values
+ * have their mark flag set.
+ *
+ * @param value The value to mark.
+ */
+static void mark_value(Value value);
+
+/** @brief Mark every key and value stored in a symbol table.
+ *
+ * Walks all of the entry chains in the table and marks both
+ * sides of each entry.
+ *
+ * @param table The symbol table to mark.
+ */
+static void mark_table(Table table);
+
+/** @brief Drop interned strings that were not marked.
+ *
+ * The vm.strings table holds weak references: it must not keep a
+ * string alive on its own, otherwise no string could ever be
+ * collected. Entries whose key was not reached from a root are
+ * unlinked here so the sweep that follows can free the strings.
+ *
+ * @param table The interned strings table.
+ */
+static void remove_unmarked_strings(Table table);
+
+/** @brief Free every object that was not marked.
+ *
+ * Walks the vm.objects list, frees unmarked objects and clears
+ * the mark flag on the survivors for the next cycle.
+ */
+static void sweep(void);
+
+/** @brief Record one reallocate call in the allocation-site profiler.
+ *
+ * Removes the record for previous if it was being tracked, then
+ * records the new allocation against the calling site and updates
+ * the live byte count and high-water mark.
+ *
+ * @param previous The pointer that was passed to reallocate.
+ * @param result The pointer realloc returned, NULL on the free path.
+ * @param new_size The new size of the allocation, zero on the free path.
+ * @param file The source file of the reallocate call.
+ * @param line The source line of the reallocate call.
+ */
+static void memory_profile_track(void *previous, void *result, size_t new_size, const char *file, int line);
 
 /** @brief Reallocate memory to the given size.
  *
@@ -30,21 +154,453 @@
  */
 void *reallocate(void *previous, size_t old_size, size_t new_size, const char *file, int line)
 {
+  // Allocation accounting and collection belong to the isolate bound
+  // to this thread. Allocations made before vm_init runs (the command
+  // line options, for example) are simply not tracked.
+  VM *vm = vm_active();
+
   if(new_size == 0)
   {
+    if(vm != NULL)
+      vm->bytes_allocated -= old_size;
+    if(memory_profiling)
+      memory_profile_track(previous, NULL, 0, file, line);
     free(previous);
     previous = NULL;
     return NULL;
   }
 
-  if(new_size > old_size)
+  if(vm != NULL)
   {
-    // Garbage collection will be here.
+    vm->bytes_allocated += new_size - old_size;
+
+    if(new_size > old_size)
+    {
+      // The VM is the only source of collectable objects, so there is
+      // nothing to do until vm_init has set up the interned strings table.
+      if(vm->strings != NULL && vm->bytes_allocated > vm->next_gc)
+        collect_garbage();
+    }
   }
 
+  // The removal half of the accounting runs before realloc frees or
+  // moves the old block, the insertion half after it.
+  if(memory_profiling)
+    memory_profile_track(previous, NULL, 0, file, line);
+
   void *result = realloc(previous, new_size);
   if(result == NULL)
     die("Memory management error.", file, line);
 
+  if(memory_profiling)
+    memory_profile_track(NULL, result, new_size, file, line);
+
   return result;
 }
+
+/** @brief Allocate from the compile-time arena.
+ *
+ * Bump-pointer allocation out of the current arena page. The memory
+ * cannot be freed individually; the whole arena is released at once
+ * with arena_release when compilation finishes.
+ *
+ * @param size The number of bytes to allocate.
+ * @return A pointer to the allocated memory.
+ */
+void *arena_alloc(size_t size)
+{
+  size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+
+  if(arena_pages == NULL || arena_pages->capacity - arena_pages->used < size)
+  {
+    size_t capacity = size > ARENA_PAGE_SIZE ? size : ARENA_PAGE_SIZE;
+    ArenaPage *page = NEW(page);
+    page->capacity  = capacity;
+    page->used      = 0;
+    page->data      = ALLOC(char, capacity);
+    page->next      = arena_pages;
+    arena_pages     = page;
+  }
+
+  void *result = arena_pages->data + arena_pages->used;
+  arena_pages->used += size;
+  return result;
+}
+
+/** @brief Release everything allocated from the arena.
+ *
+ * Frees all arena pages in one pass. Called when compile() finishes,
+ * discarding every token lexeme of the compilation wholesale.
+ */
+void arena_release(void)
+{
+  ArenaPage *page = arena_pages;
+  while(page != NULL)
+  {
+    ArenaPage *next = page->next;
+    FREE_ARRAY(char, page->data, page->capacity);
+    FREE(ArenaPage, page);
+    page = next;
+  }
+  arena_pages = NULL;
+}
+
+/** @brief Find or create the row for an allocation site.
+ *
+ * Sites are identified by the file and line the allocating macro
+ * captured. A linear scan is fine: the code base has a few dozen
+ * distinct sites and each is looked at once per allocation.
+ *
+ * @param file The source file of the reallocate call.
+ * @param line The source line of the reallocate call.
+ * @return The index of the site row.
+ */
+static int memory_site(const char *file, int line)
+{
+  for(int i = 0; i < memory_site_count; i++)
+  {
+    MemorySite *site = &memory_sites[i];
+    if(site->line == line && (site->file == file || strcmp(site->file, file) == 0))
+      return i;
+  }
+
+  // The last row is the overflow bucket once the table fills up.
+  if(memory_site_count == MEMORY_SITES_MAX)
+    return MEMORY_SITES_MAX - 1;
+
+  MemorySite *site = &memory_sites[memory_site_count];
+  site->file        = memory_site_count == MEMORY_SITES_MAX - 1 ? "(other sites)" : file;
+  site->line        = memory_site_count == MEMORY_SITES_MAX - 1 ? 0 : line;
+  site->count       = 0;
+  site->total_bytes = 0;
+  site->live_bytes  = 0;
+
+  return memory_site_count++;
+}
+
+/** @brief The probe start for a pointer in the block map.
+ *
+ * @param pointer The pointer to hash.
+ * @return The slot index to start probing from.
+ */
+static int memory_block_slot(void *pointer)
+{
+  // Allocations are aligned, so the low bits carry no information.
+  uintptr_t bits = (uintptr_t)pointer >> 4;
+  return (int)((bits * 2654435761u) & (uintptr_t)(memory_block_capacity - 1));
+}
+
+/** @brief Record a live allocation in the block map.
+ *
+ * Grows and rehashes the map at three quarters full, which also
+ * discards the slots left behind by removals.
+ *
+ * @param pointer The allocated pointer.
+ * @param site The site row the allocation belongs to.
+ * @param size The size of the allocation.
+ */
+static void memory_block_insert(void *pointer, int site, size_t size)
+{
+  if((memory_block_count + 1) * 4 > memory_block_capacity * 3)
+  {
+    int old_capacity = memory_block_capacity;
+    MemoryBlock *old_blocks = memory_blocks;
+
+    memory_block_capacity = old_capacity < 256 ? 256 : old_capacity * 2;
+    memory_blocks = calloc((size_t)memory_block_capacity, sizeof(MemoryBlock));
+    if(memory_blocks == NULL)
+      die("Memory management error.", __FILE__, __LINE__);
+    memory_block_count = 0;
+
+    for(int i = 0; i < old_capacity; i++)
+    {
+      if(old_blocks[i].pointer != NULL && old_blocks[i].site >= 0)
+        memory_block_insert(old_blocks[i].pointer, old_blocks[i].site, old_blocks[i].size);
+    }
+    free(old_blocks);
+  }
+
+  int slot = memory_block_slot(pointer);
+  while(memory_blocks[slot].pointer != NULL && memory_blocks[slot].site >= 0)
+    slot = (slot + 1) & (memory_block_capacity - 1);
+
+  memory_blocks[slot].pointer = pointer;
+  memory_blocks[slot].site    = site;
+  memory_blocks[slot].size    = size;
+  memory_block_count++;
+}
+
+/** @brief Remove a live allocation from the block map.
+ *
+ * The slot is only marked removed, not emptied, so probe chains that
+ * run through it stay intact until the next rehash.
+ *
+ * @param pointer The pointer being freed or resized.
+ * @param site Receives the site row of the allocation.
+ * @param size Receives the size of the allocation.
+ * @return True if the pointer was being tracked.
+ */
+static bool memory_block_remove(void *pointer, int *site, size_t *size)
+{
+  if(memory_block_capacity == 0)
+    return false;
+
+  int slot = memory_block_slot(pointer);
+  while(memory_blocks[slot].pointer != NULL)
+  {
+    if(memory_blocks[slot].pointer == pointer && memory_blocks[slot].site >= 0)
+    {
+      *site = memory_blocks[slot].site;
+      *size = memory_blocks[slot].size;
+      memory_blocks[slot].site = -1;
+      memory_block_count--;
+      return true;
+    }
+    slot = (slot + 1) & (memory_block_capacity - 1);
+  }
+
+  return false;
+}
+
+/** @brief Record one reallocate call in the allocation-site profiler.
+ *
+ * Removes the record for previous if it was being tracked, then
+ * records the new allocation against the calling site and updates
+ * the live byte count and high-water mark.
+ *
+ * @param previous The pointer that was passed to reallocate.
+ * @param result The pointer realloc returned, NULL on the free path.
+ * @param new_size The new size of the allocation, zero on the free path.
+ * @param file The source file of the reallocate call.
+ * @param line The source line of the reallocate call.
+ */
+static void memory_profile_track(void *previous, void *result, size_t new_size, const char *file, int line)
+{
+  if(previous != NULL)
+  {
+    int site;
+    size_t size;
+
+    // A pointer allocated before profiling began is not in the map
+    // and simply is not accounted for.
+    if(memory_block_remove(previous, &site, &size))
+    {
+      memory_sites[site].live_bytes -= size;
+      memory_live -= size;
+    }
+  }
+
+  if(result != NULL && new_size > 0)
+  {
+    int site = memory_site(file, line);
+    memory_sites[site].count++;
+    memory_sites[site].total_bytes += new_size;
+    memory_sites[site].live_bytes  += new_size;
+    memory_block_insert(result, site, new_size);
+
+    memory_live += new_size;
+    if(memory_live > memory_peak)
+      memory_peak = memory_live;
+  }
+}
+
+/** @brief Start recording allocation-site statistics.
+ *
+ * Everything that goes through reallocate from here on is attributed
+ * to the file and line of the calling macro.
+ */
+void memory_profile_begin(void)
+{
+  memory_profiling  = true;
+  memory_site_count = 0;
+  memory_live       = 0;
+  memory_peak       = 0;
+}
+
+/** @brief Print the allocation-site statistics table.
+ *
+ * Reports each site's allocation count, cumulative bytes and bytes
+ * still live, sorted by live bytes, followed by the heap high-water
+ * mark. Does nothing unless memory_profile_begin was called.
+ */
+void memory_profile_report(void)
+{
+  if(!memory_profiling)
+    return;
+
+  printf("\n== profile: memory ==\n");
+  printf("%-28s %10s %14s %14s\n", "site", "count", "total bytes", "live bytes");
+
+  // A selection sort over a few dozen sites is plenty.
+  bool reported[MEMORY_SITES_MAX] = { false };
+  for(;;)
+  {
+    int best = -1;
+    for(int i = 0; i < memory_site_count; i++)
+    {
+      if(reported[i])
+        continue;
+      if(best == -1 || memory_sites[i].live_bytes > memory_sites[best].live_bytes)
+        best = i;
+    }
+    if(best == -1)
+      break;
+
+    reported[best] = true;
+
+    char site[64];
+    if(memory_sites[best].line == 0)
+      snprintf(site, sizeof(site), "%s", memory_sites[best].file);
+    else
+      snprintf(site, sizeof(site), "%s:%d", memory_sites[best].file, memory_sites[best].line);
+
+    printf("%-28s %10llu %14zu %14zu\n",
+           site,
+           (unsigned long long)memory_sites[best].count,
+           memory_sites[best].total_bytes,
+           memory_sites[best].live_bytes);
+  }
+
+  printf("%-28s %40zu\n", "live", memory_live);
+  printf("%-28s %40zu\n", "peak", memory_peak);
+
+  memory_profiling      = false;
+  memory_block_count    = 0;
+  memory_block_capacity = 0;
+  free(memory_blocks);
+  memory_blocks = NULL;
+}
+
+/** @brief Run a garbage collection cycle.
+ *
+ * Mark every object reachable from the VM roots (the value stack, the
+ * global variables and the constants of the active, top level and
+ * module chunks), drop interned strings that were not reached, and
+ * sweep the remaining unreachable objects from the vm.objects list.
+ */
+void collect_garbage(void)
+{
+  VM *vm = vm_active();
+
+  // Mark the roots.
+  for(Value *slot = vm->stack; slot < vm->stack_top; slot++)
+    mark_value(*slot);
+
+  if(vm->globals != NULL)
+    mark_table(vm->globals);
+
+  for(int i = 0; i < vm->global_slots.count; i++)
+    mark_value(vm->global_slots.values[i]);
+
+  if(vm->chunk != NULL)
+  {
+    for(int i = 0; i < vm->chunk->constants.count; i++)
+      mark_value(vm->chunk->constants.values[i]);
+  }
+
+  // While an import runs, vm->chunk points at the module, so the top
+  // level chunk is pinned separately.
+  if(vm->script_chunk != NULL && vm->script_chunk != vm->chunk)
+  {
+    for(int i = 0; i < vm->script_chunk->constants.count; i++)
+      mark_value(vm->script_chunk->constants.values[i]);
+  }
+
+  // Module chunks stay resident for the life of the VM, so their
+  // constants and path strings are always roots.
+  for(Module *module = vm->modules; module != NULL; module = module->next)
+  {
+    module->path->object.marked = true;
+    for(int i = 0; i < module->chunk.constants.count; i++)
+      mark_value(module->chunk.constants.values[i]);
+  }
+
+  if(vm->strings != NULL)
+    remove_unmarked_strings(vm->strings);
+
+  sweep();
+
+  vm->next_gc = vm->bytes_allocated * GC_HEAP_GROW_FACTOR;
+}
+
+/** @brief Mark a single value as reachable.
+ *
+ * Immediate values carry no heap data, so only Object values
+ * have their mark flag set.
+ *
+ * @param value The value to mark.
+ */
+static void mark_value(Value value)
+{
+  // Strings hold no references to other objects, so marking does not
+  // need a worklist yet. That changes once container objects exist.
+  if(IS_OBJECT(value))
+    AS_OBJECT(value)->marked = true;
+}
+
+/** @brief Mark every key and value stored in a symbol table.
+ *
+ * Walks all of the entry chains in the table and marks both
+ * sides of each entry.
+ *
+ * @param table The symbol table to mark.
+ */
+static void mark_table(Table table)
+{
+  for(int i = 0; i < table->capacity; i++)
+  {
+    Entry *e = &table->entries[i];
+    mark_value(e->key);
+    mark_value(e->value);
+  }
+
+  if(table->parent)
+    mark_table(table->parent);
+}
+
+/** @brief Drop interned strings that were not marked.
+ *
+ * The vm.strings table holds weak references: it must not keep a
+ * string alive on its own, otherwise no string could ever be
+ * collected. Entries whose key was not reached from a root are
+ * unlinked here so the sweep that follows can free the strings.
+ *
+ * @param table The interned strings table.
+ */
+static void remove_unmarked_strings(Table table)
+{
+  for(int i = 0; i < table->capacity; i++)
+  {
+    Entry *e = &table->entries[i];
+    if(IS_OBJECT(e->key) && !AS_OBJECT(e->key)->marked)
+    {
+      // Replace the entry with a tombstone, exactly as table_delete would.
+      e->key   = create_nil();
+      e->value = create_boolean(true);
+    }
+  }
+}
+
+/** @brief Free every object that was not marked.
+ *
+ * Walks the vm.objects list, frees unmarked objects and clears
+ * the mark flag on the survivors for the next cycle.
+ */
+static void sweep(void)
+{
+  Object **link = &vm_active()->objects;
+  while(*link != NULL)
+  {
+    Object *object = *link;
+    if(object->marked)
+    {
+      object->marked = false;
+      link = &object->next;
+    }
+    else
+    {
+      *link = object->next;
+      free_object(object);
+    }
+  }
+}
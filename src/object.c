@@ -1,6 +1,6 @@
 /** @file object.c
  *
- * @brief Implementation of the Object module.
+ * @brief Implementation of the Value and Object module.
  *
  * @author David J. Lains (dlains)
  * @bug No known bugs.
@@ -12,6 +12,7 @@
 #include "common.h"
 #include "memory.h"
 #include "object.h"
+#include "writer.h"
 #include "vm.h"
 
 /** @brief Allocate an object of ObjectType type.
@@ -26,26 +27,15 @@ static Object *allocate_object(size_t size, ObjectType type);
 
 /** @brief Allocate an object of ObjectType string.
  *
- * Create a ObjectString object and set up the length and
- * chars data.
+ * Create a ObjectString object with the characters copied inline
+ * after the header, so the whole string is a single allocation.
  *
- * @param chars The raw C String characters for the ObjectString.
+ * @param chars The raw C String characters to copy in.
  * @param length The length of the C String.
+ * @param hash The precomputed hash of the characters.
  * @return The newly created ObjectString object.
  */
-static ObjectString *allocate_string(String chars, int length);
-
-/** @brief Generate a hash value for a string.
- *
- * Three kinds of objects generate a hash with a C string,
- * OBJ_STRING, OBJ_BOOLEAN, and OBJ_NIL. This function handles
- * all three cases.
- *
- * @param string The C string to hash
- * @param table_size The current hash table size.
- * @return The hash of the string.
- */
-int string_hash(const char *string, int table_size);
+static ObjectString *allocate_string(const char *chars, int length, uint32_t hash);
 
 /** Helper macro for creating Objects. */
 #define ALLOCATE_OBJECT(type, object_type)\
@@ -63,8 +53,10 @@ static Object *allocate_object(size_t size, ObjectType type)
 {
   Object *object = (Object*)reallocate(NULL, 0, size, __FILE__, __LINE__);
   object->type   = type;
-  object->next   = vm.objects;
-  vm.objects     = object;
+  object->marked = false;
+  VM *vm = vm_active();
+  object->next = vm->objects;
+  vm->objects  = object;
 
   return object;
 }
@@ -79,130 +71,213 @@ void free_object(Object *object)
 {
   switch(object->type)
   {
-    case OBJ_BOOLEAN:
-    {
-      FREE(ObjectBoolean, object);
-      break;
-    }
-    case OBJ_NIL:
-    {
-      FREE(ObjectNil, object);
-      break;
-    }
-    case OBJ_INTEGER:
-    {
-      FREE(ObjectInteger, object);
-      break;
-    }
-    case OBJ_REAL:
-    {
-      FREE(ObjectReal, object);
-      break;
-    }
     case OBJ_STRING:
     {
-      ObjectString *string = AS_STRING(object);
-      FREE_ARRAY(char, string->chars, string->length + 1);
-      FREE(ObjectString, object);
+      // The characters live inline, so the one allocation covers the
+      // header and the character data together.
+      ObjectString *string = (ObjectString*)object;
+      reallocate(object, sizeof(ObjectString) + string->length + 1, 0, __FILE__, __LINE__);
       break;
     }
   }
 }
 
-/** @brief Create a boolean object.
+/** @brief Create a boolean value.
  *
- * Take the bool value and turn it into a ObjectBoolean.
+ * Take the bool and turn it into an immediate Value.
  *
  * @param value The bool value to convert.
- * @return The newly created ObjectBoolean.
+ * @return The newly created boolean Value.
  */
-ObjectBoolean *create_boolean(bool value)
+Value create_boolean(bool value)
 {
-  ObjectBoolean *boolean = ALLOCATE_OBJECT(ObjectBoolean, OBJ_BOOLEAN);
-  boolean->value         = value;
+  Value result;
+  result.type       = VAL_BOOLEAN;
+  result.as.boolean = value;
 
-  return boolean;
+  return result;
 }
 
-/** @brief Create a nil object.
+/** @brief Create a nil value.
  *
- * Create an ObjectNil constant.
+ * Create an immediate nil Value.
  *
- * @return The newly created ObjectNil.
+ * @return The newly created nil Value.
  */
-ObjectNil *create_nil(void)
+Value create_nil(void)
 {
-  ObjectNil *nil = ALLOCATE_OBJECT(ObjectNil, OBJ_NIL);
-  nil->value     = 0;
+  Value result;
+  result.type       = VAL_NIL;
+  result.as.integer = 0;
 
-  return nil;
+  return result;
 }
 
-/** @brief Create an Integer object.
+/** @brief Create an Integer value.
  *
- * Create a new ObjectInteger value.
+ * Take the long and turn it into an immediate Value.
  *
  * @param value The integer value to convert.
- * @return The newly created ObjectInteger.
+ * @return The newly created integer Value.
+ */
+Value create_integer(long value)
+{
+  Value result;
+  result.type       = VAL_INTEGER;
+  result.as.integer = value;
+
+  return result;
+}
+
+/** @brief Create the undefined marker value.
+ *
+ * Used to mark global slots that have been allocated by the compiler
+ * but not yet assigned at runtime.
+ *
+ * @return The newly created undefined Value.
  */
-ObjectInteger *create_integer(long value)
+Value create_undefined(void)
 {
-  ObjectInteger *integer = ALLOCATE_OBJECT(ObjectInteger, OBJ_INTEGER);
-  integer->value         = value;
+  Value result;
+  result.type       = VAL_UNDEFINED;
+  result.as.integer = 0;
 
-  return integer;
+  return result;
 }
 
-/** @brief Create a Real object.
+/** @brief Create a Real value.
  *
- * Create a new ObjectReal value.
+ * Take the double and turn it into an immediate Value.
  *
  * @param value The double value to convert.
- * @return The newly crated ObjectReal.
+ * @return The newly created real Value.
+ */
+Value create_real(double value)
+{
+  Value result;
+  result.type    = VAL_REAL;
+  result.as.real = value;
+
+  return result;
+}
+
+/** @brief Create an object value.
+ *
+ * Wrap a heap allocated Object in a Value.
+ *
+ * @param object The Object to wrap.
+ * @return The newly created object Value.
  */
-ObjectReal *create_real(double value)
+Value create_object(Object *object)
 {
-  ObjectReal *real = ALLOCATE_OBJECT(ObjectReal, OBJ_REAL);
-  real->value      = value;
+  Value result;
+  result.type      = VAL_OBJECT;
+  result.as.object = object;
 
-  return real;
+  return result;
 }
 
 /** @brief Allocate an object of ObjectType string.
  *
- * Create a ObjectString object and set up the length and
- * chars data.
+ * Create a ObjectString object with the characters copied inline
+ * after the header, so the whole string is a single allocation.
  *
- * @param chars The raw C String characters for the ObjectString.
+ * @param chars The raw C String characters to copy in.
  * @param length The length of the C String.
+ * @param hash The precomputed hash of the characters.
  * @return The newly created ObjectString object.
  */
-static ObjectString *allocate_string(char *chars, int length)
+static ObjectString *allocate_string(const char *chars, int length, uint32_t hash)
 {
-  ObjectString *string = ALLOCATE_OBJECT(ObjectString, OBJ_STRING);
+  ObjectString *string = (ObjectString*)allocate_object(sizeof(ObjectString) + length + 1, OBJ_STRING);
   string->length       = length;
-  string->chars        = chars;
+  string->hash         = hash;
+  memcpy(string->chars, chars, length);
+  string->chars[length] = '\0';
 
-  table_insert(vm.strings, AS_OBJECT(string), AS_OBJECT(string));
+  // The interning table only holds weak references, so the new string
+  // is rooted on the stack while the insert below might allocate.
+  VM *vm = vm_active();
+  push(vm, create_object((Object*)string));
+  table_insert(vm->strings, create_object((Object*)string), create_object((Object*)string));
+  pop(vm);
 
   return string;
 }
 
 /** @brief Take a string and turn it into a ObjectString.
  *
- * Copies the C String into an ObjectString.
+ * Copies the C String into an ObjectString and frees the passed in
+ * buffer, so the caller hands over ownership either way.
  *
- * @param chars The C String to copy.
+ * @param chars The C String to take.
  * @param length The length of the C String.
  * @return The new ObjectString.
  */
+/** @brief Concatenate a run of string values into one new string.
+ *
+ * Sizes the result once, copies each piece into it once and interns
+ * it, so assembling a string from many pieces stays linear. The
+ * caller must keep the pieces reachable on the VM stack, since the
+ * allocation can trigger a collection.
+ *
+ * @param pieces The string values to join, in order.
+ * @param count The number of pieces.
+ * @return The ObjectString with the joined characters.
+ */
+ObjectString *concat_strings(Value *pieces, int count)
+{
+  int length = 0;
+  for(int i = 0; i < count; i++)
+    length += AS_STRING(pieces[i])->length;
+
+  ObjectString *string = (ObjectString*)allocate_object(sizeof(ObjectString) + length + 1, OBJ_STRING);
+  string->length = length;
+
+  int at = 0;
+  for(int i = 0; i < count; i++)
+  {
+    ObjectString *piece = AS_STRING(pieces[i]);
+    memcpy(string->chars + at, piece->chars, piece->length);
+    at += piece->length;
+  }
+  string->chars[length] = '\0';
+  string->hash = string_hash(string->chars, length);
+
+  // An equal string may already be interned. The fresh object is
+  // still at the head of the vm.objects list, so it can be unlinked
+  // and freed before anything else sees it.
+  ObjectString *interned = table_search_string(vm_active()->strings, string->chars, length, string->hash);
+  if(interned != NULL)
+  {
+    vm_active()->objects = string->object.next;
+    free_object((Object*)string);
+    return interned;
+  }
+
+  // The interning table only holds weak references, so the new string
+  // is rooted on the stack while the insert below might allocate.
+  VM *vm = vm_active();
+  push(vm, create_object((Object*)string));
+  table_insert(vm->strings, create_object((Object*)string), create_object((Object*)string));
+  pop(vm);
+
+  return string;
+}
+
 ObjectString *take_string(char *chars, int length)
 {
-  Object *interned = table_search_string(vm.strings, chars, length);
+  uint32_t hash = string_hash(chars, length);
+  ObjectString *interned = table_search_string(vm_active()->strings, chars, length, hash);
   if(interned != NULL)
-    return AS_STRING(interned);
+  {
+    FREE_ARRAY(char, chars, length + 1);
+    return interned;
+  }
 
-  return allocate_string(chars, length);
+  ObjectString *string = allocate_string(chars, length, hash);
+  FREE_ARRAY(char, chars, length + 1);
+  return string;
 }
 
 /** @brief Copy a string and turn it into a ObjectString.
@@ -215,205 +290,221 @@ ObjectString *take_string(char *chars, int length)
  */
 ObjectString *copy_string(const char *chars, int length)
 {
-  Object *interned = table_search_string(vm.strings, chars, length);
+  uint32_t hash = string_hash(chars, length);
+  ObjectString *interned = table_search_string(vm_active()->strings, chars, length, hash);
   if(interned != NULL)
-    return AS_STRING(interned);
-
-  char *result = ALLOC(char, length + 1);
-  memcpy(result, chars, length);
-  result[length] = '\0';
+    return interned;
 
-  return allocate_string(result, length);
+  return allocate_string(chars, length, hash);
 }
 
-/** @brief Check if Objects are equivalent.
+/** @brief Check if Values are equivalent.
  *
- * Check if the passed in objects are equivalent.
+ * Check if the passed in values are equivalent.
  *
- * @param a The first Object to check.
- * @param b The second Object to check.
- * @return True if the underlying objects are equivalent, false otherwise.
+ * @param a The first Value to check.
+ * @param b The second Value to check.
+ * @return True if the underlying values are equivalent, false otherwise.
  */
-bool objects_equal(Object *a, Object *b)
+bool values_equal(Value a, Value b)
 {
-  if(OBJ_TYPE(a) != OBJ_TYPE(b))
+  if(VALUE_TYPE(a) != VALUE_TYPE(b))
     return false;
 
-  switch(OBJ_TYPE(a))
+  switch(VALUE_TYPE(a))
   {
-    case OBJ_BOOLEAN:
+    case VAL_BOOLEAN:
+      return AS_BOOLEAN(a) == AS_BOOLEAN(b);
+    case VAL_NIL:
     {
-      ObjectBoolean* aBool = AS_BOOLEAN(a);
-      ObjectBoolean* bBool = AS_BOOLEAN(b);
-      return aBool->value == bBool->value;
-    }
-    case OBJ_NIL:
-    {
-      // Both object have already been establised to be nil, and nil always equals nil.
+      // Both values have already been establised to be nil, and nil always equals nil.
       return true;
     }
-    case OBJ_INTEGER:
-    {
-      ObjectInteger* aInt = AS_INTEGER(a);
-      ObjectInteger* bInt = AS_INTEGER(b);
-      return aInt->value == bInt->value;
-    }
-    case OBJ_REAL:
-    {
-      ObjectReal* aReal = AS_REAL(a);
-      ObjectReal* bReal = AS_REAL(b);
-      return aReal->value == bReal->value;
-    }
-    case OBJ_STRING:
+    case VAL_INTEGER:
+      return AS_INTEGER(a) == AS_INTEGER(b);
+    case VAL_REAL:
+      return AS_REAL(a) == AS_REAL(b);
+    case VAL_OBJECT:
     {
-      ObjectString* aString = AS_STRING(a);
-      ObjectString* bString = AS_STRING(b);
-      return aString->length == bString->length && memcmp(aString->chars, bString->chars, aString->length) == 0;
+      // Every ObjectString goes through copy_string, take_string or
+      // concat_strings, and all three intern against vm.strings, so
+      // two equal strings are always the same object and equality is
+      // identity.
+      return AS_OBJECT(a) == AS_OBJECT(b);
     }
     default:
       return false;
   }
 }
 
-/** @brief Print the object value to stdout.
+/** @brief Print the value to stdout.
  *
- * Print the given object to stdout.
+ * Print the given value to stdout.
  *
- * @param value The object value to print.
+ * @param value The value to print.
  */
-void print_object(Object *object)
+void print_value(Value value)
 {
-  switch(OBJ_TYPE(object))
+  switch(VALUE_TYPE(value))
   {
-    case OBJ_BOOLEAN:
-    {
-      ObjectBoolean* b = AS_BOOLEAN(object);
-      printf("%s", b->value ? "true" : "false");
+    case VAL_BOOLEAN:
+      printf("%s", AS_BOOLEAN(value) ? "true" : "false");
       break;
-    }
-    case OBJ_NIL:
+    case VAL_NIL:
       printf("nil");
       break;
-    case OBJ_INTEGER:
-    {
-      ObjectInteger* i = AS_INTEGER(object);
-      printf("%ld", i->value);
+    case VAL_INTEGER:
+      printf("%ld", AS_INTEGER(value));
       break;
-    }
-    case OBJ_REAL:
-    {
-      ObjectReal* r = AS_REAL(object);
-      printf("%g", r->value);
+    case VAL_REAL:
+      printf("%g", AS_REAL(value));
       break;
-    }
-    case OBJ_STRING:
-      printf("\"%s\"", AS_CSTRING(object));
+    case VAL_OBJECT:
+      printf("\"%s\"", AS_CSTRING(value));
       break;
     default:
-      printf("Unknown object type passed to print_object.");
+      printf("Unknown value type passed to print_value.");
       break;
   }
 }
 
-/** @brief Calculate a hash value for the object
+/** @brief Format the value into the output writer.
  *
- * Determine the type of object and calculate a hash value for it.
+ * The buffered counterpart of print_value, used by OP_PRINT. Values
+ * are converted straight into the writer's buffer so printing costs
+ * no stdio call per value.
  *
- * @param object The object to generate the hash for.
- * @param table_size The current hash table size.
- * @return The object's hash
+ * @param value The value to write.
  */
-int object_hash(Object *object, int table_size)
+void write_value(Value value)
 {
-  switch(OBJ_TYPE(object))
+  switch(VALUE_TYPE(value))
   {
-    case OBJ_BOOLEAN:
-    {
-      ObjectBoolean *b = AS_BOOLEAN(object);
-      return string_hash(b->value ? "true" : "false", table_size);
-    }
-    case OBJ_NIL:
-    {
-      return string_hash("nil", table_size);
-    }
-    case OBJ_INTEGER:
-    {
-      ObjectInteger *i = AS_INTEGER(object);
-      return ((16161 * (unsigned)i->value) % table_size);
-    }
-    case OBJ_REAL:
-    {
-      ObjectReal *r = AS_REAL(object);
-      return ((int)(.616161 * (float)r->value) % table_size);
-    }
-    case OBJ_STRING:
+    case VAL_BOOLEAN:
+      if(AS_BOOLEAN(value))
+        writer_string("true", 4);
+      else
+        writer_string("false", 5);
+      break;
+    case VAL_NIL:
+      writer_string("nil", 3);
+      break;
+    case VAL_INTEGER:
+      writer_integer(AS_INTEGER(value));
+      break;
+    case VAL_REAL:
+      writer_real(AS_REAL(value));
+      break;
+    case VAL_OBJECT:
     {
-      char *s = AS_CSTRING(object);
-      return string_hash(s, table_size);
+      ObjectString *string = AS_STRING(value);
+      writer_char('"');
+      writer_string(string->chars, string->length);
+      writer_char('"');
+      break;
     }
+    default:
+      writer_string("Unknown value type passed to write_value.", 41);
+      break;
+  }
+}
+
+/** @brief Calculate a hash value for the value.
+ *
+ * Determine the type of value and calculate a hash value for it.
+ * String values return their cached hash without touching the
+ * character data.
+ *
+ * @param value The value to generate the hash for.
+ * @return The value's hash
+ */
+uint32_t value_hash(Value value)
+{
+  switch(VALUE_TYPE(value))
+  {
+    case VAL_BOOLEAN:
+      return AS_BOOLEAN(value) ? string_hash("true", 4) : string_hash("false", 5);
+    case VAL_NIL:
+      return string_hash("nil", 3);
+    case VAL_INTEGER:
+      // Fibonacci hashing: the multiplier is 2^32 divided by the golden
+      // ratio, which scatters sequential integers across the table.
+      return (uint32_t)AS_INTEGER(value) * 2654435769u;
+    case VAL_REAL:
+      {
+        uint64_t bits;
+        memcpy(&bits, &value.as.real, sizeof(bits));
+        return (uint32_t)(bits ^ (bits >> 32)) * 2654435769u;
+      }
+    case VAL_OBJECT:
+      return AS_STRING(value)->hash;
+    default:
+      return 0;
   }
 }
 
 /** @brief Generate a hash value for a string.
  *
- * Three kinds of objects generate a hash with a C string,
- * OBJ_STRING, OBJ_BOOLEAN, and OBJ_NIL. This function handles
- * all three cases.
+ * FNV-1a over the characters. The result is independent of any
+ * table size; tables reduce it modulo their own capacity.
  *
- * @param string The C string to hash
- * @param table_size The current hash table size.
+ * @param string The characters to hash.
+ * @param length The number of characters to hash.
  * @return The hash of the string.
  */
-int string_hash(const char *string, int table_size)
+uint32_t string_hash(const char *string, int length)
 {
-  int hash, a = 31415, b = 27183;
-  for(hash = 0; *string; string++, a = a * b % (table_size - 1))
-    hash = (a * hash + *string) % table_size;
+  uint32_t hash = 2166136261u;
+  for(int i = 0; i < length; i++)
+  {
+    hash ^= (Byte)string[i];
+    hash *= 16777619u;
+  }
 
   return hash;
 }
 
-/** @brief Initialize a new object array.
+/** @brief Initialize a new value array.
  *
- * Allocate space for the initial object array structure.
+ * Allocate space for the initial value array structure.
  *
- * @param array The ObjectArray structure to initialize.
+ * @param array The ValueArray structure to initialize.
  */
-void init_object_array(ObjectArray *array)
+void init_value_array(ValueArray *array)
 {
   array->capacity = 0;
   array->count = 0;
-  array->objects = NULL;
+  array->values = NULL;
 }
 
-/** @brief Free the memory for the given ObjectArray.
+/** @brief Free the memory for the given ValueArray.
  *
- * Release the memory used for the given ObjectArray.
+ * Release the memory used for the given ValueArray.
  *
- * @param array The ObjectArray to free.
+ * @param array The ValueArray to free.
  */
-void free_object_array(ObjectArray *array)
+void free_value_array(ValueArray *array)
 {
-  FREE_ARRAY(Object, array->objects, array->capacity);
-  init_object_array(array);
+  FREE_ARRAY(Value, array->values, array->capacity);
+  init_value_array(array);
 }
 
-/** @brief Write a new object to the array.
+/** @brief Write a new value to the array.
  *
- * Add a new object to the given array.
+ * Add a new value to the given array.
  *
- * @param array The ObjectArray to add the object to.
- * @param value The object to add.
+ * @param array The ValueArray to add the value to.
+ * @param value The value to add.
  */
-void write_object_array(ObjectArray *array, Object *object)
+void write_value_array(ValueArray *array, Value value)
 {
   if(array->capacity < array->count + 1)
   {
     int old_size    = array->capacity;
     array->capacity = GROW_CAPACITY(old_size);
-    array->objects  = GROW_ARRAY(array->objects, Object*, old_size, array->capacity);
+    array->values   = GROW_ARRAY(array->values, Value, old_size, array->capacity);
   }
 
-  array->objects[array->count] = object;
+  array->values[array->count] = value;
   array->count++;
 }
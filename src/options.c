@@ -22,6 +22,9 @@
 struct options {
   char *script;         /**< The source file provided on the command line. */
   bool show_bytecode;   /**< Set if the -d / --dump flag is given. */
+  bool memory;          /**< Set if the -m / --memory flag is given. */
+  bool profile;         /**< Set if the -p / --profile flag is given. */
+  bool registers;       /**< Set if the -r / --registers flag is given. */
 };
 
 /** @brief Show command line help.
@@ -64,6 +67,9 @@ Options options_init(void)
   Options o        = NEW(o);
   o->script        = NULL;
   o->show_bytecode = false;
+  o->memory        = false;
+  o->profile       = false;
+  o->registers     = false;
 
   return o;
 }
@@ -100,12 +106,15 @@ void options_parse(Options options, int argc, char *argv[])
     static struct option long_opts[] = {
       { "dump",    no_argument,       0, 'd'},
       { "help",    no_argument,       0, 'h'},
-      { "version", no_argument,       0, 'v'},
+      { "memory",  no_argument,       0, 'm'},
+      { "profile",   no_argument,     0, 'p'},
+      { "registers", no_argument,     0, 'r'},
+      { "version",   no_argument,     0, 'v'},
       { 0,         0,                 0,  0 }
     };
 
     int opt_index = 0;
-    int c = getopt_long(argc, argv, "dhv", long_opts, &opt_index);
+    int c = getopt_long(argc, argv, "dhmprv", long_opts, &opt_index);
 
     if(c == -1)
       break;
@@ -115,6 +124,15 @@ void options_parse(Options options, int argc, char *argv[])
       case 'd':
         options->show_bytecode = true;
         break;
+      case 'm':
+        options->memory = true;
+        break;
+      case 'p':
+        options->profile = true;
+        break;
+      case 'r':
+        options->registers = true;
+        break;
       case 'v':
         print_version();
         break;
@@ -129,7 +147,7 @@ void options_parse(Options options, int argc, char *argv[])
   {
     // Copy a single argument at argv[optind] to options->script. Ignore anything
     // else on the command line.
-    options->script = ALLOC(char, strlen(argv[optind] + 1));
+    options->script = ALLOC(char, strlen(argv[optind]) + 1);
     strcpy(options->script, argv[optind]);
   }
 }
@@ -160,6 +178,42 @@ bool options_get_show_code(Options options)
   return options->show_bytecode;
 }
 
+/** @brief Get the memory option.
+ *
+ * Get the memory option from the Options structure.
+ *
+ * @return The memory option.
+ */
+bool options_get_memory(Options options)
+{
+  VALIDATE(options);
+  return options->memory;
+}
+
+/** @brief Get the profile option.
+ *
+ * Get the profile option from the Options structure.
+ *
+ * @return The profile option.
+ */
+bool options_get_profile(Options options)
+{
+  VALIDATE(options);
+  return options->profile;
+}
+
+/** @brief Get the registers option.
+ *
+ * Get the registers option from the Options structure.
+ *
+ * @return The registers option.
+ */
+bool options_get_registers(Options options)
+{
+  VALIDATE(options);
+  return options->registers;
+}
+
 /** @brief Show command line help.
  *
  * Prints a simple command line help message to stdout.
@@ -169,6 +223,9 @@ static void print_usage(void)
   printf("Usage: cube [arguments] [script]\n");
   printf("-d --dump      [tokens|code]              Dump token or bytecode information for the compiled code.\n");
   printf("-h --help                                 Show this help message.\n");
+  printf("-m --memory                               Report per allocation site memory statistics when the VM shuts down.\n");
+  printf("-p --profile                              Report opcode and line execution counts and times (requires a profile build).\n");
+  printf("-r --registers                            Run on the experimental register bytecode backend.\n");
   printf("-v --version                              Show the program version string.\n");
   printf("\n");
   exit(EXIT_SUCCESS);
@@ -0,0 +1,282 @@
+/** @file profile.c
+ *
+ * @brief Implementation of the opcode execution profiler.
+ *
+ * @author David J. Lains (dlains)
+ * @bug No known bugs.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <time.h>
+
+#include "common.h"
+#include "memory.h"
+#include "chunk.h"
+#include "profile.h"
+#include "vm.h"
+
+#ifdef PROFILE
+
+/** The number of opcodes the count arrays cover. */
+#define OPCODE_COUNT (OP_RETURN + 1)
+
+/** The printable name of each opcode, indexed by its OpCode value. */
+static const char *opcode_names[OPCODE_COUNT] = {
+  [OP_CONSTANT]      = "OP_CONSTANT",
+  [OP_POP]           = "OP_POP",
+  [OP_NIL]           = "OP_NIL",
+  [OP_TRUE]          = "OP_TRUE",
+  [OP_FALSE]         = "OP_FALSE",
+  [OP_GET_LOCAL]     = "OP_GET_LOCAL",
+  [OP_SET_LOCAL]     = "OP_SET_LOCAL",
+  [OP_GET_GLOBAL]    = "OP_GET_GLOBAL",
+  [OP_DEFINE_GLOBAL] = "OP_DEFINE_GLOBAL",
+  [OP_SET_GLOBAL]    = "OP_SET_GLOBAL",
+  [OP_EQUAL]         = "OP_EQUAL",
+  [OP_GREATER]       = "OP_GREATER",
+  [OP_LESS]          = "OP_LESS",
+  [OP_ADD]           = "OP_ADD",
+  [OP_SUBTRACT]      = "OP_SUBTRACT",
+  [OP_MULTIPLY]      = "OP_MULTIPLY",
+  [OP_DIVIDE]        = "OP_DIVIDE",
+  [OP_MODULUS]       = "OP_MODULUS",
+  [OP_POWER]         = "OP_POWER",
+  [OP_NOT]           = "OP_NOT",
+  [OP_NEGATE]        = "OP_NEGATE",
+  [OP_PRINT]         = "OP_PRINT",
+  [OP_JUMP]          = "OP_JUMP",
+  [OP_JUMP_IF_FALSE] = "OP_JUMP_IF_FALSE",
+  [OP_LOOP]          = "OP_LOOP",
+  [OP_ADD_CONST]                 = "OP_ADD_CONST",
+  [OP_SUBTRACT_CONST]            = "OP_SUBTRACT_CONST",
+  [OP_LESS_CONST]                = "OP_LESS_CONST",
+  [OP_GREATER_CONST]             = "OP_GREATER_CONST",
+  [OP_JUMP_IF_NOT_LESS]          = "OP_JUMP_IF_NOT_LESS",
+  [OP_JUMP_IF_NOT_GREATER]       = "OP_JUMP_IF_NOT_GREATER",
+  [OP_JUMP_IF_NOT_LESS_CONST]    = "OP_JUMP_IF_NOT_LESS_CONST",
+  [OP_JUMP_IF_NOT_GREATER_CONST] = "OP_JUMP_IF_NOT_GREATER_CONST",
+  [OP_ADD_INT]       = "OP_ADD_INT",
+  [OP_ADD_REAL]      = "OP_ADD_REAL",
+  [OP_SUBTRACT_INT]  = "OP_SUBTRACT_INT",
+  [OP_SUBTRACT_REAL] = "OP_SUBTRACT_REAL",
+  [OP_MULTIPLY_INT]  = "OP_MULTIPLY_INT",
+  [OP_MULTIPLY_REAL] = "OP_MULTIPLY_REAL",
+  [OP_CONCAT_N]      = "OP_CONCAT_N",
+  [OP_CONSTANT_LONG]      = "OP_CONSTANT_LONG",
+  [OP_GET_LOCAL_LONG]     = "OP_GET_LOCAL_LONG",
+  [OP_SET_LOCAL_LONG]     = "OP_SET_LOCAL_LONG",
+  [OP_GET_GLOBAL_LONG]    = "OP_GET_GLOBAL_LONG",
+  [OP_DEFINE_GLOBAL_LONG] = "OP_DEFINE_GLOBAL_LONG",
+  [OP_SET_GLOBAL_LONG]    = "OP_SET_GLOBAL_LONG",
+  [OP_IMPORT]        = "OP_IMPORT",
+  [OP_RETURN]        = "OP_RETURN",
+};
+
+/** Set once profile_begin has been called. */
+static bool enabled = false;
+
+/** Executions per opcode. */
+static uint64_t op_count[OPCODE_COUNT];
+
+/** Accumulated wall time per opcode in nanoseconds. */
+static uint64_t op_nanos[OPCODE_COUNT];
+
+/** Executions per source line, indexed by line number. */
+static uint64_t *line_count = NULL;
+
+/** Accumulated wall time per source line in nanoseconds. */
+static uint64_t *line_nanos = NULL;
+
+/** The number of line slots allocated. */
+static int line_capacity = 0;
+
+/** The opcode whose handler is currently running, or -1 at the start of a run. */
+static int last_op = -1;
+
+/** The line whose instruction is currently running. */
+static int last_line = 0;
+
+/** The timestamp taken when the current instruction was dispatched. */
+static uint64_t last_time = 0;
+
+/** @brief Read the monotonic clock in nanoseconds.
+ *
+ * @return The current monotonic time in nanoseconds.
+ */
+static uint64_t profile_nanos(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/** @brief Make sure the line arrays cover the given line number.
+ *
+ * Grows the per-line count and time arrays, zero filling the new
+ * slots, whenever an instruction from a higher line executes.
+ *
+ * @param line The line number that must be indexable.
+ */
+static void ensure_line_capacity(int line)
+{
+  if(line < line_capacity)
+    return;
+
+  int old_capacity = line_capacity;
+  int new_capacity = old_capacity == 0 ? 64 : old_capacity;
+  while(new_capacity <= line)
+    new_capacity *= 2;
+
+  line_count = GROW_ARRAY(line_count, uint64_t, old_capacity, new_capacity);
+  line_nanos = GROW_ARRAY(line_nanos, uint64_t, old_capacity, new_capacity);
+  for(int i = old_capacity; i < new_capacity; i++)
+  {
+    line_count[i] = 0;
+    line_nanos[i] = 0;
+  }
+
+  line_capacity = new_capacity;
+}
+
+/** @brief Turn the profiler on for this process.
+ *
+ * Called when the -p / --profile option is given. Resets the
+ * accumulated counts so the report covers a single session.
+ */
+void profile_begin(void)
+{
+  enabled = true;
+  last_op = -1;
+}
+
+/** @brief Is the profiler collecting?
+ *
+ * @return True once profile_begin has been called.
+ */
+bool profile_enabled(void)
+{
+  return enabled;
+}
+
+/** @brief Record and consume the next instruction.
+ *
+ * Attributes the elapsed time since the previous step to the opcode
+ * and line that just finished, then counts the instruction the VM is
+ * about to execute and advances the instruction pointer past its
+ * opcode byte, exactly as READ_BYTE would.
+ *
+ * @return The opcode byte to dispatch on.
+ */
+Byte profile_step(void)
+{
+  uint64_t now = profile_nanos();
+  if(last_op != -1)
+  {
+    uint64_t elapsed = now - last_time;
+    op_nanos[last_op]     += elapsed;
+    line_nanos[last_line] += elapsed;
+  }
+
+  VM *vm = vm_active();
+  Byte op = *vm->ip;
+  int line = chunk_get_line(vm->chunk, (int)(vm->ip - vm->chunk->code));
+
+  ensure_line_capacity(line);
+  op_count[op]++;
+  line_count[line]++;
+
+  last_op   = op;
+  last_line = line;
+
+  // Take a fresh timestamp so the bookkeeping above is not charged to
+  // the instruction itself.
+  last_time = profile_nanos();
+
+  vm->ip++;
+  return op;
+}
+
+/** @brief Print the ranked profile report.
+ *
+ * Lists every executed opcode and source line with its execution
+ * count, accumulated wall time and share of the total, ordered by
+ * accumulated time. Does nothing when the profiler never ran.
+ */
+void profile_report(void)
+{
+  if(!enabled)
+    return;
+
+  uint64_t total_nanos = 0;
+  uint64_t total_count = 0;
+  for(int i = 0; i < OPCODE_COUNT; i++)
+  {
+    total_nanos += op_nanos[i];
+    total_count += op_count[i];
+  }
+
+  if(total_count == 0)
+    return;
+
+  if(total_nanos == 0)
+    total_nanos = 1;
+
+  printf("\n== profile: opcodes ==\n");
+  printf("%-18s %12s %12s %7s\n", "opcode", "count", "time (ms)", "%");
+
+  // A selection sort over a few dozen opcodes is plenty.
+  bool reported[OPCODE_COUNT] = { false };
+  for(;;)
+  {
+    int best = -1;
+    for(int i = 0; i < OPCODE_COUNT; i++)
+    {
+      if(reported[i] || op_count[i] == 0)
+        continue;
+      if(best == -1 || op_nanos[i] > op_nanos[best])
+        best = i;
+    }
+    if(best == -1)
+      break;
+
+    reported[best] = true;
+    printf("%-18s %12llu %12.3f %6.1f%%\n",
+           opcode_names[best],
+           (unsigned long long)op_count[best],
+           op_nanos[best] / 1e6,
+           100.0 * op_nanos[best] / total_nanos);
+  }
+
+  printf("\n== profile: lines ==\n");
+  printf("%-18s %12s %12s %7s\n", "line", "count", "time (ms)", "%");
+
+  for(;;)
+  {
+    int best = -1;
+    for(int i = 0; i < line_capacity; i++)
+    {
+      if(line_count[i] == 0)
+        continue;
+      if(best == -1 || line_nanos[i] > line_nanos[best])
+        best = i;
+    }
+    if(best == -1)
+      break;
+
+    printf("%-18d %12llu %12.3f %6.1f%%\n",
+           best,
+           (unsigned long long)line_count[best],
+           line_nanos[best] / 1e6,
+           100.0 * line_nanos[best] / total_nanos);
+    line_count[best] = 0;
+  }
+
+  FREE_ARRAY(uint64_t, line_count, line_capacity);
+  FREE_ARRAY(uint64_t, line_nanos, line_capacity);
+  line_count    = NULL;
+  line_nanos    = NULL;
+  line_capacity = 0;
+  enabled       = false;
+}
+
+#endif // PROFILE
@@ -0,0 +1,813 @@
+/** @file register.c
+ *
+ * @brief Implementation of the stack to register code translator.
+ *
+ * @author David J. Lains (dlains)
+ * @bug No known bugs.
+ */
+#include "config.h"
+#include "common.h"
+#include "memory.h"
+#include "register.h"
+
+/** Where a stack position's value currently lives during translation. */
+typedef enum
+{
+  SOURCE_REG,               /**< The value is in a register. */
+  SOURCE_CONST              /**< The value is a constant not yet loaded. */
+} SourceKind;
+
+/** The source descriptor for one stack position. */
+typedef struct
+{
+  SourceKind kind;          /**< Register or pending constant. */
+  int index;                /**< The register number or constant index. */
+} Source;
+
+/** @struct The translator state.
+ *
+ * Tracks the simulated stack depth, where each stack position's value
+ * lives, and the bookkeeping needed to rewrite jumps from stack code
+ * offsets to register code offsets.
+ */
+typedef struct
+{
+  Chunk *chunk;             /**< The stack chunk being translated. */
+  RegChunk *reg;            /**< The register chunk being filled. */
+  Source sources[REGISTER_MAX]; /**< Descriptor per stack position. */
+  int depth;                /**< The simulated stack depth. */
+  bool depth_known;         /**< False right after an unconditional jump. */
+  bool *is_target;          /**< Per stack offset: is it a jump target. */
+  int *target_depth;        /**< Per stack offset: stack depth at the target. */
+  int *reg_offset;          /**< Per stack offset: matching register code offset. */
+  int *patch_at;            /**< Register offsets of unpatched forward jumps. */
+  int *patch_target;        /**< The stack offset each forward jump lands on. */
+  int patch_count;          /**< The number of pending patches. */
+  int line;                 /**< The source line of the current instruction. */
+  int retarget_offset;      /**< Code offset of the last dst operand, or -1. */
+  int retarget_position;    /**< The stack position that dst produced. */
+} Translator;
+
+/** @brief The encoded length of a stack instruction.
+ *
+ * @param op The stack opcode.
+ * @return The instruction length in bytes, or -1 when the translator
+ * does not cover the opcode.
+ */
+static int stack_op_length(Byte op)
+{
+  switch(op)
+  {
+    case OP_POP:
+    case OP_NIL:
+    case OP_TRUE:
+    case OP_FALSE:
+    case OP_EQUAL:
+    case OP_GREATER:
+    case OP_LESS:
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_MODULUS:
+    case OP_POWER:
+    case OP_NOT:
+    case OP_NEGATE:
+    case OP_PRINT:
+    case OP_IMPORT:
+    case OP_RETURN:
+      return 1;
+    case OP_CONSTANT:
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_GET_GLOBAL:
+    case OP_DEFINE_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_ADD_CONST:
+    case OP_SUBTRACT_CONST:
+    case OP_LESS_CONST:
+    case OP_GREATER_CONST:
+    case OP_CONCAT_N:
+      return 2;
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_LOOP:
+    case OP_JUMP_IF_NOT_LESS:
+    case OP_JUMP_IF_NOT_GREATER:
+      return 3;
+    case OP_JUMP_IF_NOT_LESS_CONST:
+    case OP_JUMP_IF_NOT_GREATER_CONST:
+      return 4;
+    default:
+      // Wide operand forms and the quickened opcodes fall back to the
+      // stack loop.
+      return -1;
+  }
+}
+
+/** @brief Append one byte of register code.
+ *
+ * Grows the code and line arrays together and records the source line
+ * of the stack instruction being translated.
+ *
+ * @param t The translator.
+ * @param byte The code byte to append.
+ */
+static void emit(Translator *t, Byte byte)
+{
+  RegChunk *reg = t->reg;
+  if(reg->capacity < reg->count + 1)
+  {
+    int old_capacity = reg->capacity;
+    reg->capacity = GROW_CAPACITY(old_capacity);
+    reg->code  = GROW_ARRAY(reg->code, Byte, old_capacity, reg->capacity);
+    reg->lines = GROW_ARRAY(reg->lines, int, old_capacity, reg->capacity);
+  }
+
+  reg->code[reg->count]  = byte;
+  reg->lines[reg->count] = t->line;
+  reg->count++;
+}
+
+/** @brief Make sure a stack position's value is in its home register.
+ *
+ * Emits the deferred load or move for a position whose value is still
+ * a pending constant or lives in another register.
+ *
+ * @param t The translator.
+ * @param position The stack position to materialize.
+ */
+static void materialize(Translator *t, int position)
+{
+  Source source = t->sources[position];
+  if(source.kind == SOURCE_REG && source.index == position)
+    return;
+
+  if(source.kind == SOURCE_CONST)
+  {
+    emit(t, REG_LOAD_CONST);
+    emit(t, (Byte)position);
+    emit(t, (Byte)source.index);
+  }
+  else
+  {
+    emit(t, REG_MOVE);
+    emit(t, (Byte)position);
+    emit(t, (Byte)source.index);
+  }
+
+  t->sources[position].kind  = SOURCE_REG;
+  t->sources[position].index = position;
+}
+
+/** @brief Materialize every stack position below the limit.
+ *
+ * Called before jumps and at jump targets so all control flow paths
+ * agree that position p lives in register p.
+ *
+ * @param t The translator.
+ * @param limit Materialize positions 0 to limit - 1.
+ */
+static void flush(Translator *t, int limit)
+{
+  for(int position = 0; position < limit; position++)
+    materialize(t, position);
+}
+
+/** @brief Resolve a stack position to a register operand.
+ *
+ * A pending constant is loaded into the position's home register
+ * first; a value already in some register is used where it is.
+ *
+ * @param t The translator.
+ * @param position The stack position to resolve.
+ * @return The register holding the value.
+ */
+static int operand(Translator *t, int position)
+{
+  if(t->sources[position].kind == SOURCE_CONST)
+    materialize(t, position);
+
+  return t->sources[position].index;
+}
+
+/** @brief Record the depth a jump target will be entered with.
+ *
+ * @param t The translator.
+ * @param target The stack offset of the target.
+ * @param depth The stack depth on the jumping path.
+ * @return False when another path already recorded a different depth.
+ */
+static bool record_target_depth(Translator *t, int target, int depth)
+{
+  if(t->target_depth[target] < 0)
+  {
+    t->target_depth[target] = depth;
+    return true;
+  }
+
+  return t->target_depth[target] == depth;
+}
+
+/** @brief Translate one binary operator.
+ *
+ * Emits the constant fused form when the right operand is a pending
+ * constant and the operator has one, otherwise the register form.
+ * The result lands in the home register of the left operand's
+ * position, which is where the stack machine would have left it.
+ *
+ * @param t The translator.
+ * @param op The register form of the operator.
+ * @param op_c The constant fused form, or REG_RETURN for none.
+ */
+static void binary(Translator *t, RegOp op, RegOp op_c)
+{
+  int dst = t->depth - 2;
+  Source right = t->sources[t->depth - 1];
+
+  if(op_c != REG_RETURN && right.kind == SOURCE_CONST)
+  {
+    int a = operand(t, dst);
+    emit(t, (Byte)op_c);
+    emit(t, (Byte)dst);
+    emit(t, (Byte)a);
+    emit(t, (Byte)right.index);
+  }
+  else
+  {
+    int a = operand(t, dst);
+    int b = operand(t, t->depth - 1);
+    emit(t, (Byte)op);
+    emit(t, (Byte)dst);
+    emit(t, (Byte)a);
+    emit(t, (Byte)b);
+  }
+
+  t->sources[dst].kind  = SOURCE_REG;
+  t->sources[dst].index = dst;
+  t->depth--;
+
+  t->retarget_offset   = t->reg->count - 3;
+  t->retarget_position = dst;
+}
+
+/** @brief Translate one of the op-with-constant superinstructions.
+ *
+ * The stack form pops one operand and pushes the result, so the
+ * register form reads and writes the same position.
+ *
+ * @param t The translator.
+ * @param op_c The constant fused register operator.
+ * @param k The constant index operand.
+ */
+static void binary_constant(Translator *t, RegOp op_c, Byte k)
+{
+  int dst = t->depth - 1;
+  int a = operand(t, dst);
+
+  emit(t, (Byte)op_c);
+  emit(t, (Byte)dst);
+  emit(t, (Byte)a);
+  emit(t, k);
+
+  t->sources[dst].kind  = SOURCE_REG;
+  t->sources[dst].index = dst;
+
+  t->retarget_offset   = t->reg->count - 3;
+  t->retarget_position = dst;
+}
+
+/** @brief Translate a unary operator.
+ *
+ * @param t The translator.
+ * @param op The register form of the operator.
+ */
+static void unary(Translator *t, RegOp op)
+{
+  int dst = t->depth - 1;
+  int src = operand(t, dst);
+
+  emit(t, (Byte)op);
+  emit(t, (Byte)dst);
+  emit(t, (Byte)src);
+
+  t->sources[dst].kind  = SOURCE_REG;
+  t->sources[dst].index = dst;
+
+  t->retarget_offset   = t->reg->count - 2;
+  t->retarget_position = dst;
+}
+
+/** @brief Translate a stack chunk into register code.
+ *
+ * @param chunk The compiled stack chunk to translate.
+ * @param reg The register chunk to fill in.
+ * @return True on success, false when the chunk uses something the
+ * translator does not cover and the stack loop should run instead.
+ */
+bool register_translate(Chunk *chunk, RegChunk *reg)
+{
+  reg->count     = 0;
+  reg->capacity  = 0;
+  reg->code      = NULL;
+  reg->lines     = NULL;
+  reg->registers = 0;
+  reg->constants = &chunk->constants;
+
+  Translator t;
+  t.chunk            = chunk;
+  t.reg              = reg;
+  t.depth            = 0;
+  t.depth_known      = true;
+  t.patch_count      = 0;
+  t.line             = 1;
+  t.retarget_offset  = -1;
+  t.retarget_position = -1;
+
+  int count       = chunk->count;
+  t.is_target     = ALLOC(bool, count + 1);
+  t.target_depth  = ALLOC(int, count + 1);
+  t.reg_offset    = ALLOC(int, count + 1);
+  t.patch_at      = ALLOC(int, count + 1);
+  t.patch_target  = ALLOC(int, count + 1);
+
+  for(int i = 0; i <= count; i++)
+  {
+    t.is_target[i]    = false;
+    t.target_depth[i] = -1;
+    t.reg_offset[i]   = -1;
+  }
+
+  bool ok = true;
+
+  // First pass: check every opcode is covered and mark jump targets,
+  // so the second pass can materialize pending values at each label.
+  for(int offset = 0; offset < count && ok; )
+  {
+    Byte op = chunk->code[offset];
+    int length = stack_op_length(op);
+    if(length < 0)
+    {
+      ok = false;
+      break;
+    }
+
+    int target = -1;
+    switch(op)
+    {
+      case OP_JUMP:
+      case OP_JUMP_IF_FALSE:
+      case OP_JUMP_IF_NOT_LESS:
+      case OP_JUMP_IF_NOT_GREATER:
+        target = offset + length + ((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+        break;
+      case OP_JUMP_IF_NOT_LESS_CONST:
+      case OP_JUMP_IF_NOT_GREATER_CONST:
+        target = offset + length + ((chunk->code[offset + 2] << 8) | chunk->code[offset + 3]);
+        break;
+      case OP_LOOP:
+        target = offset + length - ((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+        break;
+    }
+
+    if(target != -1)
+    {
+      if(target < 0 || target > count)
+      {
+        ok = false;
+        break;
+      }
+      t.is_target[target] = true;
+    }
+
+    offset += length;
+  }
+
+  // Second pass: simulate the stack and emit register instructions.
+  for(int offset = 0; offset < count && ok; )
+  {
+    if(t.is_target[offset])
+    {
+      // Every path into a label agrees that position p lives in
+      // register p, so materialize the fall-through path to match.
+      if(t.depth_known)
+      {
+        flush(&t, t.depth);
+        if(!record_target_depth(&t, offset, t.depth))
+        {
+          ok = false;
+          break;
+        }
+      }
+      else if(t.target_depth[offset] >= 0)
+      {
+        t.depth = t.target_depth[offset];
+        t.depth_known = true;
+      }
+      else
+      {
+        ok = false;
+        break;
+      }
+
+      for(int p = 0; p < t.depth; p++)
+      {
+        t.sources[p].kind  = SOURCE_REG;
+        t.sources[p].index = p;
+      }
+
+      t.reg_offset[offset] = reg->count;
+      t.retarget_offset = -1;
+    }
+
+    if(!t.depth_known)
+    {
+      ok = false;
+      break;
+    }
+
+    Byte op = chunk->code[offset];
+    int length = stack_op_length(op);
+    t.line = chunk_get_line(chunk, offset);
+
+    int retarget_offset   = t.retarget_offset;
+    int retarget_position = t.retarget_position;
+    t.retarget_offset = -1;
+
+    switch(op)
+    {
+      case OP_CONSTANT:
+      {
+        // Every push site checks the depth before touching sources:
+        // the guard below the switch only sees the depth after the
+        // instruction, which is one write too late.
+        if(t.depth >= REGISTER_MAX)
+        {
+          ok = false;
+          break;
+        }
+        int k = chunk->code[offset + 1];
+        t.sources[t.depth].kind  = SOURCE_CONST;
+        t.sources[t.depth].index = k;
+        t.depth++;
+        break;
+      }
+      case OP_POP:
+        t.depth--;
+        break;
+      case OP_NIL:
+      case OP_TRUE:
+      case OP_FALSE:
+      {
+        if(t.depth >= REGISTER_MAX)
+        {
+          ok = false;
+          break;
+        }
+        Byte load = op == OP_NIL ? REG_LOAD_NIL : op == OP_TRUE ? REG_LOAD_TRUE : REG_LOAD_FALSE;
+        emit(&t, load);
+        emit(&t, (Byte)t.depth);
+        t.sources[t.depth].kind  = SOURCE_REG;
+        t.sources[t.depth].index = t.depth;
+        t.retarget_offset   = reg->count - 1;
+        t.retarget_position = t.depth;
+        t.depth++;
+        break;
+      }
+      case OP_GET_LOCAL:
+      {
+        if(t.depth >= REGISTER_MAX)
+        {
+          ok = false;
+          break;
+        }
+        // No code at all: the local already lives in its register, so
+        // the new stack position just refers to it.
+        int slot = chunk->code[offset + 1];
+        t.sources[t.depth] = t.sources[slot];
+        t.depth++;
+        break;
+      }
+      case OP_SET_LOCAL:
+      {
+        int slot = chunk->code[offset + 1];
+        int top = t.depth - 1;
+
+        // Positions still reading the local's old value get a copy
+        // before the store clobbers it.
+        int before = reg->count;
+        for(int p = 0; p < top; p++)
+        {
+          if(p != slot && t.sources[p].kind == SOURCE_REG && t.sources[p].index == slot)
+            materialize(&t, p);
+        }
+        bool clobbered = reg->count != before;
+
+        Source value = t.sources[top];
+        if(value.kind == SOURCE_CONST)
+        {
+          emit(&t, REG_LOAD_CONST);
+          emit(&t, (Byte)slot);
+          emit(&t, (Byte)value.index);
+        }
+        else if(value.index == slot)
+        {
+          // Storing the local into itself.
+        }
+        else if(!clobbered && retarget_offset >= 0 && retarget_position == top
+               && value.index == top)
+        {
+          // The value was produced by the previous instruction, so
+          // point its dst straight at the local instead of moving.
+          reg->code[retarget_offset] = (Byte)slot;
+        }
+        else
+        {
+          emit(&t, REG_MOVE);
+          emit(&t, (Byte)slot);
+          emit(&t, (Byte)value.index);
+        }
+
+        t.sources[slot].kind  = SOURCE_REG;
+        t.sources[slot].index = slot;
+
+        // The assignment peeks, so the top position now refers to the
+        // local's register.
+        t.sources[top].kind  = SOURCE_REG;
+        t.sources[top].index = slot;
+        break;
+      }
+      case OP_GET_GLOBAL:
+      {
+        if(t.depth >= REGISTER_MAX)
+        {
+          ok = false;
+          break;
+        }
+        int slot = chunk->code[offset + 1];
+        emit(&t, REG_GET_GLOBAL);
+        emit(&t, (Byte)t.depth);
+        emit(&t, (Byte)(slot >> 8));
+        emit(&t, (Byte)(slot & 0xff));
+        t.sources[t.depth].kind  = SOURCE_REG;
+        t.sources[t.depth].index = t.depth;
+        t.retarget_offset   = reg->count - 3;
+        t.retarget_position = t.depth;
+        t.depth++;
+        break;
+      }
+      case OP_DEFINE_GLOBAL:
+      case OP_SET_GLOBAL:
+      {
+        int slot = chunk->code[offset + 1];
+        int src = operand(&t, t.depth - 1);
+        emit(&t, op == OP_SET_GLOBAL ? REG_SET_GLOBAL : REG_DEFINE_GLOBAL);
+        emit(&t, (Byte)(slot >> 8));
+        emit(&t, (Byte)(slot & 0xff));
+        emit(&t, (Byte)src);
+        if(op == OP_DEFINE_GLOBAL)
+          t.depth--;
+        break;
+      }
+      case OP_EQUAL:
+        binary(&t, REG_EQUAL, REG_RETURN);
+        break;
+      case OP_GREATER:
+        binary(&t, REG_GREATER, REG_GREATER_C);
+        break;
+      case OP_LESS:
+        binary(&t, REG_LESS, REG_LESS_C);
+        break;
+      case OP_ADD:
+        binary(&t, REG_ADD, REG_ADD_C);
+        break;
+      case OP_SUBTRACT:
+        binary(&t, REG_SUBTRACT, REG_SUBTRACT_C);
+        break;
+      case OP_MULTIPLY:
+        binary(&t, REG_MULTIPLY, REG_MULTIPLY_C);
+        break;
+      case OP_DIVIDE:
+        binary(&t, REG_DIVIDE, REG_RETURN);
+        break;
+      case OP_MODULUS:
+        binary(&t, REG_MODULUS, REG_RETURN);
+        break;
+      case OP_POWER:
+        binary(&t, REG_POWER, REG_RETURN);
+        break;
+      case OP_ADD_CONST:
+        binary_constant(&t, REG_ADD_C, chunk->code[offset + 1]);
+        break;
+      case OP_SUBTRACT_CONST:
+        binary_constant(&t, REG_SUBTRACT_C, chunk->code[offset + 1]);
+        break;
+      case OP_LESS_CONST:
+        binary_constant(&t, REG_LESS_C, chunk->code[offset + 1]);
+        break;
+      case OP_GREATER_CONST:
+        binary_constant(&t, REG_GREATER_C, chunk->code[offset + 1]);
+        break;
+      case OP_NOT:
+        unary(&t, REG_NOT);
+        break;
+      case OP_NEGATE:
+        unary(&t, REG_NEGATE);
+        break;
+      case OP_PRINT:
+      {
+        int src = operand(&t, t.depth - 1);
+        emit(&t, REG_PRINT);
+        emit(&t, (Byte)src);
+        t.depth--;
+        break;
+      }
+      case OP_CONCAT_N:
+      {
+        int pieces = chunk->code[offset + 1];
+        int base = t.depth - pieces;
+        // The executor needs the pieces contiguous, which is exactly
+        // the home slot layout.
+        flush(&t, t.depth);
+        emit(&t, REG_CONCAT_N);
+        emit(&t, (Byte)base);
+        emit(&t, (Byte)pieces);
+        t.depth = base + 1;
+        break;
+      }
+      case OP_IMPORT:
+      {
+        int src = operand(&t, t.depth - 1);
+        emit(&t, REG_IMPORT);
+        emit(&t, (Byte)src);
+        t.depth--;
+        break;
+      }
+      case OP_JUMP:
+      {
+        int target = offset + length + ((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+        flush(&t, t.depth);
+        emit(&t, REG_JUMP);
+        emit(&t, 0);
+        emit(&t, 0);
+        t.patch_at[t.patch_count] = reg->count - 2;
+        t.patch_target[t.patch_count] = target;
+        t.patch_count++;
+        ok = record_target_depth(&t, target, t.depth);
+        t.depth_known = false;
+        break;
+      }
+      case OP_JUMP_IF_FALSE:
+      {
+        int target = offset + length + ((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+        flush(&t, t.depth);
+        emit(&t, REG_JUMP_IF_FALSE);
+        emit(&t, (Byte)(t.depth - 1));
+        emit(&t, 0);
+        emit(&t, 0);
+        t.patch_at[t.patch_count] = reg->count - 2;
+        t.patch_target[t.patch_count] = target;
+        t.patch_count++;
+        ok = record_target_depth(&t, target, t.depth);
+        break;
+      }
+      case OP_JUMP_IF_NOT_LESS:
+      case OP_JUMP_IF_NOT_GREATER:
+      {
+        int target = offset + length + ((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+        flush(&t, t.depth - 2);
+        Source right = t.sources[t.depth - 1];
+        int a = operand(&t, t.depth - 2);
+        if(right.kind == SOURCE_CONST)
+        {
+          emit(&t, op == OP_JUMP_IF_NOT_LESS ? REG_JUMP_IF_NOT_LESS_C : REG_JUMP_IF_NOT_GREATER_C);
+          emit(&t, (Byte)a);
+          emit(&t, (Byte)right.index);
+        }
+        else
+        {
+          int b = operand(&t, t.depth - 1);
+          emit(&t, op == OP_JUMP_IF_NOT_LESS ? REG_JUMP_IF_NOT_LESS : REG_JUMP_IF_NOT_GREATER);
+          emit(&t, (Byte)a);
+          emit(&t, (Byte)b);
+        }
+        emit(&t, 0);
+        emit(&t, 0);
+        t.patch_at[t.patch_count] = reg->count - 2;
+        t.patch_target[t.patch_count] = target;
+        t.patch_count++;
+        t.depth -= 2;
+        ok = record_target_depth(&t, target, t.depth);
+        break;
+      }
+      case OP_JUMP_IF_NOT_LESS_CONST:
+      case OP_JUMP_IF_NOT_GREATER_CONST:
+      {
+        int target = offset + length + ((chunk->code[offset + 2] << 8) | chunk->code[offset + 3]);
+        flush(&t, t.depth - 1);
+        int a = operand(&t, t.depth - 1);
+        emit(&t, op == OP_JUMP_IF_NOT_LESS_CONST ? REG_JUMP_IF_NOT_LESS_C : REG_JUMP_IF_NOT_GREATER_C);
+        emit(&t, (Byte)a);
+        emit(&t, chunk->code[offset + 1]);
+        emit(&t, 0);
+        emit(&t, 0);
+        t.patch_at[t.patch_count] = reg->count - 2;
+        t.patch_target[t.patch_count] = target;
+        t.patch_count++;
+        t.depth -= 1;
+        ok = record_target_depth(&t, target, t.depth);
+        break;
+      }
+      case OP_LOOP:
+      {
+        int target = offset + length - ((chunk->code[offset + 1] << 8) | chunk->code[offset + 2]);
+        flush(&t, t.depth);
+        if(t.reg_offset[target] < 0 || t.target_depth[target] != t.depth)
+        {
+          ok = false;
+          break;
+        }
+        int distance = (reg->count + 3) - t.reg_offset[target];
+        if(distance > UINT16_MAX)
+        {
+          ok = false;
+          break;
+        }
+        emit(&t, REG_LOOP);
+        emit(&t, (Byte)(distance >> 8));
+        emit(&t, (Byte)(distance & 0xff));
+        t.depth_known = false;
+        break;
+      }
+      case OP_RETURN:
+        emit(&t, REG_RETURN);
+        t.depth_known = false;
+        break;
+      default:
+        ok = false;
+        break;
+    }
+
+    // The simulation must stay inside one byte operands; anything
+    // deeper falls back to the stack loop.
+    if(t.depth < 0 || t.depth > REGISTER_MAX)
+      ok = false;
+    if(t.depth > reg->registers)
+      reg->registers = t.depth;
+
+    offset += length;
+  }
+
+  // A jump can land exactly at the end of the code.
+  if(ok && t.is_target[count])
+    t.reg_offset[count] = reg->count;
+
+  // Constants must fit the one byte operand of REG_LOAD_CONST.
+  if(chunk->constants.count > REGISTER_MAX)
+    ok = false;
+
+  // Patch the forward jumps now that every label's register offset is
+  // known.
+  for(int i = 0; i < t.patch_count && ok; i++)
+  {
+    int target = t.reg_offset[t.patch_target[i]];
+    int distance = target - (t.patch_at[i] + 2);
+    if(target < 0 || distance < 0 || distance > UINT16_MAX)
+    {
+      ok = false;
+      break;
+    }
+    reg->code[t.patch_at[i]]     = (Byte)(distance >> 8);
+    reg->code[t.patch_at[i] + 1] = (Byte)(distance & 0xff);
+  }
+
+  FREE_ARRAY(bool, t.is_target, count + 1);
+  FREE_ARRAY(int, t.target_depth, count + 1);
+  FREE_ARRAY(int, t.reg_offset, count + 1);
+  FREE_ARRAY(int, t.patch_at, count + 1);
+  FREE_ARRAY(int, t.patch_target, count + 1);
+
+  if(!ok)
+    register_free(reg);
+
+  return ok;
+}
+
+/** @brief Free the code of a translated register chunk.
+ *
+ * The borrowed constants belong to the stack chunk and are left
+ * alone.
+ *
+ * @param reg The register chunk to free.
+ */
+void register_free(RegChunk *reg)
+{
+  FREE_ARRAY(Byte, reg->code, reg->capacity);
+  FREE_ARRAY(int, reg->lines, reg->capacity);
+  reg->count     = 0;
+  reg->capacity  = 0;
+  reg->code      = NULL;
+  reg->lines     = NULL;
+  reg->registers = 0;
+  reg->constants = NULL;
+}
@@ -16,11 +16,21 @@
 /** The main scanner variable is a Source buffer that is read a character
  * at a time looking for valid tokens.
  */
-Source scanner = NULL;
+__thread Source scanner = NULL;
 
 static Token make_token(TokenType type);
 static Token error_token(const char *message);
 static Token string();
+
+/** @brief Get the next token from the input stream.
+ *
+ * This is the main scanner driver function. It skips whitespace,
+ * starts a new token and then scans the input stream for a valid
+ * token.
+ *
+ * @return The scanned token, or an error token.
+ */
+static Token next_token();
 static Token number();
 static Token identifier();
 static TokenType identifier_type();
@@ -108,19 +118,33 @@ void remove_current_buffer()
   source_destroy(scanner);
 }
 
-/** @brief Get the next token from the input stream.
- *
- * This is the main scanner driver function. It skips whitespace,
- * starts a new token and then scans the input stream for a valid
- * token.
+/** @brief Fill a caller provided array with scanned tokens.
  *
- * If it finds a valid token it calls `make_token` to create it,
- * otherwise it calls `error_token` to create a token with an error
- * message.
+ * Scans up to count tokens into the array in one call, so the parser
+ * pays the scanner call overhead once per batch instead of once per
+ * token. A batch always ends early at the first TOKEN_EOF, which is
+ * included, so the caller can deal with the source buffer stack
+ * before asking for more. Error tokens are included like any other.
  *
- * @return The scanned token, or an error token.
+ * @param tokens The array to fill with scanned tokens.
+ * @param count The capacity of the array.
+ * @return The number of tokens placed in the array.
  */
-Token next_token()
+int scan_tokens(Token *tokens, int count)
+{
+  int filled = 0;
+  while(filled < count)
+  {
+    Token token = next_token();
+    tokens[filled++] = token;
+    if(token.type == TOKEN_EOF)
+      break;
+  }
+
+  return filled;
+}
+
+static Token next_token()
 {
   skip_whitespace(scanner);
 
@@ -204,12 +228,12 @@ static Token make_token(TokenType type)
     case TOKEN_INTEGER:
     case TOKEN_REAL:
     {
-      String lexeme = string_copy(start_position(scanner), token_length(scanner));
+      String lexeme = string_copy_arena(start_position(scanner), token_length(scanner));
       return token_create(type, lexeme, line_number(scanner), col_number(scanner));
     }
     case TOKEN_STRING:
     {
-      String lexeme = string_copy(start_position(scanner) + 1, token_length(scanner) - 2);
+      String lexeme = string_copy_arena(start_position(scanner) + 1, token_length(scanner) - 2);
       return token_create(type, lexeme, line_number(scanner), col_number(scanner));
     }
     default:
@@ -229,7 +253,7 @@ static Token make_token(TokenType type)
  */
 static Token error_token(const char *message)
 {
-  String lexeme = string_init(message);
+  String lexeme = string_init_arena(message);
   return token_create(TOKEN_ERROR, lexeme, line_number(scanner), col_number(scanner));
 }
 
@@ -250,14 +274,9 @@ static Token error_token(const char *message)
  */
 static Token string()
 {
-  while(peek(scanner) != '"' && !is_at_end(scanner))
-  {
-    if(peek(scanner) == '\n')
-    {
-      increment_line(scanner);
-    }
-    advance(scanner);
-  }
+  // Jump straight to the closing quote; the source module counts any
+  // newlines crossed on the way.
+  advance_to(scanner, '"');
 
   if(is_at_end(scanner))
     return error_token("Unterminated string.");
@@ -326,7 +345,7 @@ static Token identifier()
  */
 static TokenType identifier_type()
 {
-  String identifier = string_copy(start_position(scanner), token_length(scanner));
+  String identifier = string_copy_arena(start_position(scanner), token_length(scanner));
 
   int type = find_keyword(identifier);
   if(type != 0)
@@ -8,6 +8,10 @@
 #include "config.h"
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "common.h"
 #include "memory.h"
 #include "source.h"
@@ -21,6 +25,7 @@ struct source {
   const char *start;       /**< The start of the current token being scanned. */
   const char *current;     /**< The current location in the buffer. */
   const char *file;        /**< The full path to the file associated with this buffer. NULL for non file buffers. */
+  size_t map_size;         /**< The length of the memory mapping backing buffer, or zero for heap buffers. */
   int line;                /**< The current line number. */
   int col;                 /**< The current column. */
 };
@@ -33,6 +38,21 @@ struct source {
  */
 static char *source_read_file(const char *file_path);
 
+/** @brief Memory map a source file.
+ *
+ * Map a source file read-only instead of copying it onto the heap, so
+ * large scripts are paged in on demand. The scanner relies on a NUL
+ * byte terminating the buffer; a private mapping zero-fills the tail
+ * of the last page, so the mapping is only usable when the file size
+ * is not an exact multiple of the page size. When it is, or when the
+ * mapping fails, the caller falls back to source_read_file.
+ *
+ * @param file_path The full path to the file to map.
+ * @param size Receives the length of the mapping on success.
+ * @return The mapped buffer, or NULL if the file cannot be mapped.
+ */
+static char *source_map_file(const char *file_path, size_t *size);
+
 /** @brief Create a new source buffer.
  *
  * Create a new source buffer from a pre-allocated buffer.
@@ -42,13 +62,14 @@ static char *source_read_file(const char *file_path);
  */
 Source source_create(const char *source)
 {
-  Source s   = NEW(s);
-  s->buffer  = string_init(source);
-  s->start   = s->buffer;
-  s->current = s->buffer;
-  s->file    = NULL;
-  s->line    = 1;
-  s->col     = 1;
+  Source s    = NEW(s);
+  s->buffer   = string_init(source);
+  s->start    = s->buffer;
+  s->current  = s->buffer;
+  s->file     = NULL;
+  s->map_size = 0;
+  s->line     = 1;
+  s->col      = 1;
 
   return s;
 }
@@ -62,13 +83,16 @@ Source source_create(const char *source)
  */
 Source source_create_file(const char *file_path)
 {
-  Source s   = NEW(s);
-  s->buffer  = source_read_file(file_path);
-  s->start   = s->buffer;
-  s->current = s->buffer;
-  s->file    = file_path;
-  s->line    = 1;
-  s->col     = 1;
+  Source s    = NEW(s);
+  s->map_size = 0;
+  s->buffer   = source_map_file(file_path, &s->map_size);
+  if(s->buffer == NULL)
+    s->buffer = source_read_file(file_path);
+  s->start    = s->buffer;
+  s->current  = s->buffer;
+  s->file     = file_path;
+  s->line     = 1;
+  s->col      = 1;
 
   return s;
 }
@@ -81,7 +105,10 @@ Source source_create_file(const char *file_path)
  */
 void source_destroy(Source s)
 {
-  FREE(char, s->buffer);
+  if(s->map_size != 0)
+    munmap(s->buffer, s->map_size);
+  else
+    FREE(char, s->buffer);
   FREE(Source, s);
 }
 
@@ -194,15 +221,21 @@ void skip_whitespace(Source s)
       case '\t':
       case '\f':
       case '\v':
-        advance(s);
+      {
+        // Blanks arrive in long runs in indented sources, so skip the
+        // whole run in one strspn call instead of a byte at a time.
+        size_t run = strspn(s->current, " \r\t\f\v");
+        s->current += run;
+        s->col     += (int)run;
         break;
+      }
       case '\n':
         increment_line(s);
         advance(s);
         break;
       case '#':
-        while(peek(s) != '\n' && !is_at_end(s))
-          advance(s);
+        // The comment body is everything up to the end of the line.
+        advance_to(s, '\n');
         break;
       default:
         return;
@@ -210,6 +243,39 @@ void skip_whitespace(Source s)
   }
 }
 
+/** @brief Advance to the next occurrence of a character.
+ *
+ * Moves the current pointer to the next occurrence of the given
+ * character, or to the end of the buffer when it does not occur
+ * again. The library search routines scan whole words at a time, so
+ * this is the fast path for comment bodies and string literals. The
+ * line and column counters are updated in bulk for the skipped span.
+ *
+ * @param s The source buffer to advance.
+ * @param c The character to stop at.
+ */
+void advance_to(Source s, char c)
+{
+  const char *stop = strchr(s->current, c);
+  if(stop == NULL)
+    stop = s->current + strlen(s->current);
+
+  // Count the newlines crossed so the line and column stay accurate.
+  const char *at = s->current;
+  const char *nl;
+  while((nl = memchr(at, '\n', (size_t)(stop - at))) != NULL)
+  {
+    // Match the byte loop this replaces: increment_line resets the
+    // column and the advance over the newline bumps it to two.
+    s->line = s->line + 1;
+    s->col  = 2;
+    at = nl + 1;
+  }
+
+  s->col += (int)(stop - at);
+  s->current = stop;
+}
+
 /** @brief Advance the scanner on character and return the current character.
  *
  * Move the current pointer on character forward and return
@@ -277,6 +343,50 @@ bool match(Source s, char expected)
   return true;
 }
 
+/** @brief Memory map a source file.
+ *
+ * Map a source file read-only instead of copying it onto the heap, so
+ * large scripts are paged in on demand. The scanner relies on a NUL
+ * byte terminating the buffer; a private mapping zero-fills the tail
+ * of the last page, so the mapping is only usable when the file size
+ * is not an exact multiple of the page size. When it is, or when the
+ * mapping fails, the caller falls back to source_read_file.
+ *
+ * @param file_path The full path to the file to map.
+ * @param size Receives the length of the mapping on success.
+ * @return The mapped buffer, or NULL if the file cannot be mapped.
+ */
+static char *source_map_file(const char *file_path, size_t *size)
+{
+  int fd = open(file_path, O_RDONLY);
+  if(fd == -1)
+    return NULL;
+
+  struct stat info;
+  if(fstat(fd, &info) == -1 || info.st_size <= 0)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  // A file whose size is an exact multiple of the page size leaves no
+  // room in the mapping for the NUL sentinel the scanner expects.
+  long page_size = sysconf(_SC_PAGESIZE);
+  if(page_size <= 0 || info.st_size % page_size == 0)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data == MAP_FAILED)
+    return NULL;
+
+  *size = (size_t)info.st_size;
+  return data;
+}
+
 /** @brief Read a source file.
  *
  * Read a source file into a buffer.
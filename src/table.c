@@ -16,21 +16,34 @@
 
 #define TABLE_MAX_LOAD 0.75
 
-/** @brief Look for an existing entry.
+/** @brief Check if the slot holds no live entry.
  *
- * Used both when searching for an entry and before
- * inserting a new entry.
+ * Both empty slots and tombstones have a nil key.
  *
- * @param table The symbol table to search through.
- * @param key The Object key to search for.
- * @return The found entry or null if it was not found.
+ * @param entry The slot to check.
+ * @return True if no live entry occupies the slot.
  */
-static Entry table_find_entry(Table table, Object *key);
+static bool entry_is_vacant(Entry *entry);
+
+/** @brief Find the slot for the given key.
+ *
+ * Probes linearly from the key's home slot. Returns the slot holding
+ * the key if it is present, otherwise the slot where it should be
+ * inserted. A tombstone passed on the way is reused for insertion so
+ * deleted slots do not go to waste.
+ *
+ * @param entries The slot array to probe.
+ * @param capacity The size of the slot array.
+ * @param key The Value key to locate.
+ * @return The slot for the key.
+ */
+static Entry *table_find_entry(Entry *entries, int capacity, Value key);
 
 /** @brief Resize the symbol table.
  *
  * When the symbol table gets close to its capacity it will be resized
- * to make room for existing and new entries.
+ * to make room for existing and new entries. Tombstones are dropped
+ * during the rebuild.
  *
  * @param table The symbol table to resize.
  */
@@ -55,8 +68,8 @@ void table_init(Table table)
 
 /** @brief Free the resources used by this symbol table.
  *
- * Release any objects in the symbol table and then release
- * the table itself.
+ * Release the flat entries array. The entries themselves live inline
+ * in the array, so there is nothing to free per entry.
  *
  * @param table The symbol table to free.
  */
@@ -64,46 +77,70 @@ void table_free(Table table)
 {
   assert(table != NULL);
 
-  for(int i = 0; i < table->capacity; i++)
-  {
-    for(Entry e = table->entries[i]; e != NULL; e = e->next)
-    {
-      FREE(Entry*, e);
-    }
-  }
   FREE_ARRAY(Entry, table->entries, table->capacity);
   table_init(table);
 }
 
-/** @brief Look for an existing entry.
+/** @brief Check if the slot holds no live entry.
  *
- * Used both when searching for an entry and before
- * inserting a new entry.
+ * Both empty slots and tombstones have a nil key.
  *
- * @param table The symbol table to search through.
- * @param key The Object key to search for.
- * @return The found entry or null if it was not found.
+ * @param entry The slot to check.
+ * @return True if no live entry occupies the slot.
  */
-static Entry table_find_entry(Table table, Object *key)
+static bool entry_is_vacant(Entry *entry)
 {
-  assert(table != NULL);
-  assert(key != NULL);
+  return IS_NIL(entry->key);
+}
 
-  int hash = object_hash(key, table->capacity);
+/** @brief Find the slot for the given key.
+ *
+ * Probes linearly from the key's home slot. Returns the slot holding
+ * the key if it is present, otherwise the slot where it should be
+ * inserted. A tombstone passed on the way is reused for insertion so
+ * deleted slots do not go to waste.
+ *
+ * @param entries The slot array to probe.
+ * @param capacity The size of the slot array.
+ * @param key The Value key to locate.
+ * @return The slot for the key.
+ */
+static Entry *table_find_entry(Entry *entries, int capacity, Value key)
+{
+  unsigned index = value_hash(key) % (unsigned)capacity;
+  Entry *tombstone = NULL;
 
-  for(Entry e = table->entries[hash]; e != NULL; e = e->next)
+  for(;;)
   {
-    if(objects_equal(e->key, key))
-      return e;
-  }
+    Entry *entry = &entries[index];
+    if(IS_NIL(entry->key))
+    {
+      if(IS_NIL(entry->value))
+      {
+        // A truly empty slot ends the probe sequence.
+        return tombstone != NULL ? tombstone : entry;
+      }
+      else
+      {
+        // A tombstone. Remember the first one for reuse.
+        if(tombstone == NULL)
+          tombstone = entry;
+      }
+    }
+    else if(values_equal(entry->key, key))
+    {
+      return entry;
+    }
 
-  return NULL;
+    index = (index + 1) % (unsigned)capacity;
+  }
 }
 
 /** @brief Resize the symbol table.
  *
  * When the symbol table gets close to its capacity it will be resized
- * to make room for existing and new entries.
+ * to make room for existing and new entries. Tombstones are dropped
+ * during the rebuild.
  *
  * @param table The symbol table to resize.
  */
@@ -111,37 +148,39 @@ static void table_resize(Table table)
 {
   assert(table != NULL);
 
+  // The allocation can trigger a collection that walks this table, so
+  // the table fields are only updated once the new array is in place.
   int orig_capacity = table->capacity;
-  table->capacity = GROW_CAPACITY(table->capacity);
-  Entry *entries = ALLOC(Entry, table->capacity);
+  int new_capacity  = GROW_CAPACITY(orig_capacity);
+  Entry *entries    = ALLOC(Entry, new_capacity);
 
   // Zero out the new entries.
-  for(int i = 0; i < table->capacity; i++)
-    entries[i] = NULL;
+  for(int i = 0; i < new_capacity; i++)
+  {
+    entries[i].key   = create_nil();
+    entries[i].value = create_nil();
+  }
 
-  // Re-hash the existing entries.
-  table->count = 0;
+  // Re-hash the existing entries. Tombstones are left behind, so the
+  // count is rebuilt from the live entries alone.
+  int count = 0;
   for(int i = 0; i < orig_capacity; i++)
   {
-    for(Entry e = table->entries[i]; e != NULL; e = e->next)
-    {
-      int hash = object_hash(e->key, table->capacity);
-      if(entries[hash])
-      {
-        e->next = entries[hash];
-        entries[hash] = e;
-      }
-      else
-      {
-        entries[hash] = e;
-      }
-    }
-    table->count++;
+    Entry *e = &table->entries[i];
+    if(entry_is_vacant(e))
+      continue;
+
+    Entry *dest = table_find_entry(entries, new_capacity, e->key);
+    dest->key   = e->key;
+    dest->value = e->value;
+    count++;
   }
 
   // Free the existing entries.
   FREE_ARRAY(Entry, table->entries, orig_capacity);
-  table->entries = entries;
+  table->entries  = entries;
+  table->capacity = new_capacity;
+  table->count    = count;
 }
 
 /** @brief Search the symbol table.
@@ -149,42 +188,39 @@ static void table_resize(Table table)
  * Search the symbol table for an entry matching the given key.
  *
  * @param table The symbol table to search in.
- * @param key The Object key to look for.
- * @return The Object value found for the key, or null if the key is not in the symbol table.
+ * @param key The Value key to look for.
+ * @return A pointer to the Value found for the key, or null if the key is not in the symbol table.
  */
-Object *table_search(Table table, Object *key)
+Value *table_search(Table table, Value key)
 {
   assert(table != NULL);
-  assert(key != NULL);
 
-  if(table->entries == NULL)
+  if(table->entries != NULL)
   {
-    if(table->parent)
-      return table_search(table->parent, key);
-    else
-      return NULL;
+    Entry *entry = table_find_entry(table->entries, table->capacity, key);
+    if(!entry_is_vacant(entry))
+      return &entry->value;
   }
 
-  Entry entry = table_find_entry(table, key);
-  if(entry)
-    return entry->value;
-
   if(table->parent)
     return table_search(table->parent, key);
-  else
-    return NULL;
+
+  return NULL;
 }
 
 /** @brief Search the symbol table for a C string.
  *
- * Search the symbol table for a C string entry.
+ * Search the symbol table for a C string entry. The caller passes
+ * the hash of the characters so interning can hash a string exactly
+ * once and reuse it here and at creation.
  *
  * @param table The symbol table to search in.
  * @param string The C String to search for.
  * @param length The length of the C String..
- * @return The Object value found for the key, or null if the key is not in the symbol table.
+ * @param hash The precomputed hash of the C String.
+ * @return The interned ObjectString found for the key, or null if the key is not in the symbol table.
  */
-Object *table_search_string(Table table, const char *string, int length)
+ObjectString *table_search_string(Table table, const char *string, int length, uint32_t hash)
 {
   assert(table != NULL);
   assert(string != NULL);
@@ -193,107 +229,83 @@ Object *table_search_string(Table table, const char *string, int length)
   if(table->entries == NULL)
     return NULL;
 
-  int hash = string_hash(string, table->capacity);
+  unsigned index = hash % (unsigned)table->capacity;
 
-  for(Entry e = table->entries[hash]; e != NULL; e = e->next)
+  for(;;)
   {
-    ObjectString *s = AS_STRING(e->key);
-    if(s->length == length && memcmp(s->chars, string, length) == 0)
-      return e->value;
-  }
+    Entry *entry = &table->entries[index];
+    if(IS_NIL(entry->key))
+    {
+      // Stop at a truly empty slot, but probe past tombstones.
+      if(IS_NIL(entry->value))
+        return NULL;
+    }
+    else if(IS_STRING(entry->key))
+    {
+      // The cached hash rules out almost every non-match before the
+      // character data is ever touched.
+      ObjectString *s = AS_STRING(entry->key);
+      if(s->hash == hash && s->length == length && memcmp(s->chars, string, length) == 0)
+        return s;
+    }
 
-  return NULL;
+    index = (index + 1) % (unsigned)table->capacity;
+  }
 }
 
 /** @brief Add a new entry to the symbol table.
  *
- * Create a new Entry with the given key and value and insert it
- * into the symbol table.
+ * Store the key and value in the slot found for the key, growing
+ * the table first when the load factor gets too high.
  *
  * @param table The symbol table to insert the new entry into.
- * @param key The Object key to assign to the Entry key.
- * @param value The Object value to assign to the Entry value.
+ * @param key The Value key to assign to the Entry key.
+ * @param value The Value to assign to the Entry value.
  */
-void table_insert(Table table, Object *key, Object *value)
+void table_insert(Table table, Value key, Value value)
 {
   assert(table != NULL);
-  assert(key != NULL);
-  assert(value != NULL);
 
   if(table->count + 1 > table->capacity * TABLE_MAX_LOAD)
   {
     table_resize(table);
   }
 
-  Entry entry = table_find_entry(table, key);
-  if(entry)
+  Entry *entry = table_find_entry(table->entries, table->capacity, key);
+  if(entry_is_vacant(entry))
   {
-    // Update an existing table entry.
-    entry->value = value;
+    // A brand new slot counts toward the load factor. A reused
+    // tombstone was already counted when its old entry was added.
+    if(IS_NIL(entry->value))
+      table->count++;
   }
-  else
-  {
-    // Create a new table entry.
-    int hash = object_hash(key, table->capacity);
-
-    Entry new_entry = NEW(entry);
-    new_entry->key = key;
-    new_entry->value = value;
 
-    if(table->entries[hash])
-    {
-      new_entry->next = table->entries[hash];
-      table->entries[hash] = new_entry;
-    }
-    else
-    {
-      table->entries[hash] = new_entry;
-    }
-
-    table->count++;
-  }
+  entry->key   = key;
+  entry->value = value;
 }
 
 /** @brief Remove an Entry from the symbol table.
  *
- * Find an Entry in the symbol table matching the given key and
- * remove it from the symbol table.
+ * Find the slot matching the given key and replace it with a
+ * tombstone so probe sequences passing through it stay intact.
  *
  * @param table The symbol table to delete the Entry from.
- * @param key The Object key to find the Entry with.
+ * @param key The Value key to find the Entry with.
  */
-void table_delete(Table table, Object *key)
+void table_delete(Table table, Value key)
 {
   assert(table != NULL);
-  assert(key != NULL);
 
   if(table->count == 0)
     return;
 
-  Entry entry = table_find_entry(table, key);
-  if(entry == NULL)
-    return;
-
-  int hash = object_hash(key, table->capacity);
-  Entry head = table->entries[hash];
-  if(objects_equal(key, head->key))
-  {
-    table->entries[hash] = head->next;
-    table->count--;
+  Entry *entry = table_find_entry(table->entries, table->capacity, key);
+  if(entry_is_vacant(entry))
     return;
-  }
 
-  while(head->next != NULL)
-  {
-    if(objects_equal(key, head->next->key))
-    {
-      head->next = head->next->next;
-      table->count--;
-      return;
-    }
-    head = head->next;
-  }
-  return;
+  // Leave a tombstone: nil key with a non-nil value.
+  entry->key   = create_nil();
+  entry->value = create_boolean(true);
 }
 
 /** @brief Merge two symbol tables into a single table.
@@ -310,10 +322,9 @@ void table_merge(Table from, Table to)
 
   for(int i = 0; i < from->capacity; i++)
   {
-    for(Entry e = from->entries[i]; e != NULL; e = e->next)
-    {
+    Entry *e = &from->entries[i];
+    if(!entry_is_vacant(e))
       table_insert(to, e->key, e->value);
-    }
   }
   table_free(from);
 }
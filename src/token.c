@@ -54,25 +54,11 @@ Token token_duplicate(Token source)
   token.col    = source.col;
 
   if(source.lexeme != NULL)
-    token.lexeme = string_copy(source.lexeme, strlen(source.lexeme));
+    token.lexeme = string_copy_arena(source.lexeme, strlen(source.lexeme));
 
   return token;
 }
 
-/** @brief Free the tokens resources.
- *
- * Check to see if lexeme is not null. If not, free the memory.
- *
- * @param token The token to free.
- */
-void token_free(Token token)
-{
-  if(token.lexeme != NULL)
-  {
-    FREE(char, token.lexeme);
-  }
-}
-
 /** @brief Translate a token enum id to a user friendly token name.
  *
  * This function returns the token name for a given token id. If the token
@@ -165,6 +151,8 @@ const char *token_name(TokenType type)
       return "TOKEN_FALSE";
     case TOKEN_IF:
       return "TOKEN_IF";
+    case TOKEN_IMPORT:
+      return "TOKEN_IMPORT";
     case TOKEN_NEXT:
       return "TOKEN_NEXT";
     case TOKEN_NIL:
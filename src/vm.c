@@ -10,21 +10,37 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include "cache.h"
 #include "common.h"
 #include "compiler.h"
 #include "debug.h"
 #include "object.h"
 #include "memory.h"
+#include "profile.h"
+#include "register.h"
+#include "scanner.h"
 #include "vm.h"
+#include "writer.h"
 
-/** The global virutal machine variable used by the Virtual Machine. */
-VM vm;
+/** The VM bound to the current thread. The allocator, the compiler
+ * and the string interner reach the running isolate through this, so
+ * independent VMs can run in parallel on separate threads. */
+static __thread VM *active_vm = NULL;
 
 /** @brief Reset the stack.
  *
  * Reset the stack.
  */
-static void reset_stack();
+static void reset_stack(VM *vm);
+
+/** @brief Double the capacity of the value stack.
+ *
+ * Grows the stack array and rebases stack_top on the new allocation.
+ * Called by push once the last free slot is used, so the stack always
+ * has room for the next value and growth never runs while the value
+ * being pushed is unrooted.
+ */
+static void grow_stack(VM *vm);
 
 /** @brief Display a runtime error message to stderr.
  *
@@ -33,7 +49,7 @@ static void reset_stack();
  *
  * @param format The standard printf style format string.
  */
-static void runtime_error(const char *format, ...);
+static void runtime_error(VM *vm, const char *format, ...);
 
 /** @brief Run the code in the Chunk array.
  *
@@ -42,126 +58,283 @@ static void runtime_error(const char *format, ...);
  *
  * @return The InterpretResult of running the code.
  */
-static InterpretResult run();
+static InterpretResult run(VM *vm);
+
+/** @brief Run translated register code.
+ *
+ * The parallel executor for the register backend. The register file is
+ * the bottom of the value stack, so locals sit in the same slots the
+ * stack loop would use and the collector roots the registers for free.
+ *
+ * @param vm The VM to run on.
+ * @param reg The translated register chunk to execute.
+ * @return The InterpretResult of running the code.
+ */
+static InterpretResult run_registers(VM *vm, RegChunk *reg);
+
+/** @brief Display a runtime error from the register executor.
+ *
+ * The register executor keeps its own instruction pointer into the
+ * register code, so it cannot use runtime_error, which reports the
+ * line from vm->ip.
+ *
+ * @param format The standard printf style format string.
+ */
+static void register_error(VM *vm, RegChunk *reg, Byte *ip, const char *format, ...);
 
 /** @brief Perform the greater than comparison operation.
  *
  * Checks to see if operand one is greater than operand two. The values
  * can be either integer or real values.
  */
-static void do_greater();
+static void do_greater(VM *vm);
 
 /** @brief Perform the less than comparison operation.
  *
  * Check to see if operand one is less than operand two. The values
  * can be either integer or real values.
  */
-static void do_less();
+static void do_less(VM *vm);
 
 /** @brief Perform the addition operation.
  *
  * Adds two number values. The values can be either integer or real
  * values.
  */
-static void do_addition();
+static void do_addition(VM *vm);
 
 /** @brief Perform the subtraction operation.
  *
  * Subtracts two number values. The values can be either integer or
  * real values.
  */
-static void do_subtraction();
+static void do_subtraction(VM *vm);
 
 /** @brief Perform the multiplication operation.
  *
  * Multiplies two number values. The values can be either integer or
  * real values.
  */
-static void do_multiplication();
+static void do_multiplication(VM *vm);
 
 /** @brief Perform the division operation.
  *
  * Divide two number values. The values can be either integer or real
  * values.
  */
-static void do_division();
+static void do_division(VM *vm);
 
 /** @brief Perform the modulo operation.
  *
  * Take the modulus of two integers. The values must be integers.
  */
-static void do_modulo();
+static void do_modulo(VM *vm);
 
 /** @brief Perform the exponentiation operation.
  *
  * Raise an integer to a power of another integer.
  */
-static void do_power();
+static void do_power(VM *vm);
+
+/** @brief Arithmetic on values for the register executor.
+ *
+ * The do_ helpers above work through the stack, so the register
+ * executor, whose operands sit in registers, uses these value forms
+ * instead. The promotion rules are identical: two integers stay an
+ * integer and any real operand promotes the result to real.
+ */
+static Value value_add(Value a, Value b);
+static Value value_subtract(Value a, Value b);
+static Value value_multiply(Value a, Value b);
+static Value value_divide(Value a, Value b);
+static Value value_power(Value a, Value b);
+
+/** @brief Comparisons on values for the register executor.
+ *
+ * The same integer and real promotion as do_less and do_greater.
+ */
+static bool value_less(Value a, Value b);
+static bool value_greater(Value a, Value b);
 
 /** @brief Perform a negation operation.
  *
  * Negate the numeric value.
  */
-static void do_negate();
+static void do_negate(VM *vm);
 
-/** @brief Check if the object is false.
+/** @brief Check if the value is false.
  *
  * False is defined as NIL or `false`. Everything else is true.
  *
- * @param object The object to check for false-ness.
+ * @param value The value to check for false-ness.
  * @return True if the value is false, otherwise false.
  */
-static bool is_falsey(Object *object);
+static bool is_falsey(Value value);
 
 /** @brief Concatenate two ObjectString objects.
  *
  * Used for string concatenation using the '+' operator.
  */
-static void do_concatenate();
+static void do_concatenate(VM *vm);
 
-/** @brief Peek at an object in the stack.
+/** @brief Peek at a value in the stack.
  *
- * Returns but does not remove an object at distance offset
+ * Returns but does not remove a value at distance offset
  * from the top of the stack.
  *
  * @param distance The distance from the top of the stack to look at.
- * @return The object found in the stack.
+ * @return The value found in the stack.
  */
-static Object *peek(int distance);
+static Value peek(VM *vm, int distance);
 
 /** @brief Release the linked list of objects from the VM.
  *
  * Free the memory for all of the object linked in vm.objects.
  */
-static void free_objects();
+static void free_objects(VM *vm);
+
+/** @brief Find the name bound to a global slot.
+ *
+ * Walks the global name table looking for the entry whose slot index
+ * matches. Only used to build error messages, so the linear scan is
+ * fine.
+ *
+ * @param slot The global slot index to look up.
+ * @return The variable name, or "?" if the slot has no name.
+ */
+static const char *global_name(VM *vm, int slot);
+
+/** @brief Load and run an imported module.
+ *
+ * Looks the path up in the module registry first. A path that is
+ * already registered was loaded by an earlier import and its chunk is
+ * shared by reference, so the import is a no-op. Otherwise the file
+ * is compiled into a new resident chunk, registered, and its body is
+ * run once in place of the importing chunk.
+ *
+ * @param vm The VM to run the module on.
+ * @param path The file path of the module to import.
+ * @return The interpret result of loading and running the module.
+ */
+static InterpretResult import_module(VM *vm, ObjectString *path);
 
-/** @brief Initialize the virtual machine.
+/** @brief Initialize a virtual machine isolate.
  *
- * Create the VM structure and store any command line
- * options that were provided.
+ * Set up the caller-provided VM structure and store any command line
+ * options that were provided. The VM becomes the active isolate on
+ * the calling thread.
  *
+ * @param vm The VM to initialize.
  * @param options The command line options.
  */
-void vm_init(Options options)
+void vm_init(VM *vm, Options options)
 {
-  vm.options = options;
-  vm.globals = ALLOC(struct table, 1);
-  table_init(vm.globals);
-  vm.strings = ALLOC(struct table, 1);
-  table_init(vm.strings);
-  vm.objects = NULL;
-  reset_stack();
+  vm->options = options;
+
+#ifndef PROFILE
+  // The profiling hooks are compiled out of normal builds so the
+  // dispatch loop pays nothing for them.
+  if(options_get_profile(options))
+    fprintf(stderr, "This build has no profiling support. Rebuild with 'make profile' to use --profile.\n");
+#endif
+
+  // Memory profiling is a runtime flag. Started before the first
+  // allocation below so everything the VM ever allocates is
+  // attributed to its call site.
+  if(options_get_memory(options))
+    memory_profile_begin();
+
+  // The storage comes from the caller, so clear every field the
+  // allocator inspects before the first allocation goes through it.
+  vm->chunk        = NULL;
+  vm->script_chunk = NULL;
+  vm->ip           = NULL;
+  vm->globals = NULL;
+  vm->strings = NULL;
+  vm->modules = NULL;
+  vm->objects = NULL;
+  vm->bytes_allocated = 0;
+  vm->next_gc = 1024 * 1024;
+  init_value_array(&vm->global_slots);
+
+  vm_activate(vm);
+
+  vm->stack = NULL;
+  vm->frame = NULL;
+  vm->stack_capacity = 0;
+  grow_stack(vm);
+  reset_stack(vm);
+
+  vm->globals = ALLOC(struct table, 1);
+  table_init(vm->globals);
+  vm->strings = ALLOC(struct table, 1);
+  table_init(vm->strings);
 }
 
 /** @brief Free the resources used by the virtual machine.
  *
  * Release any memory and resources used by the virtual machine.
  */
-void vm_free()
+void vm_free(VM *vm)
 {
-  table_free(vm.globals);
-  table_free(vm.strings);
-  free_objects();
+#ifdef PROFILE
+  profile_report();
+#endif
+
+  // Reported before teardown so the live column shows the heap as the
+  // script left it rather than the remains of the teardown itself.
+  memory_profile_report();
+
+  table_free(vm->globals);
+  FREE(struct table, vm->globals);
+  free_value_array(&vm->global_slots);
+  table_free(vm->strings);
+  FREE(struct table, vm->strings);
+
+  Module *module = vm->modules;
+  while(module != NULL)
+  {
+    Module *next = module->next;
+    free_chunk(&module->chunk);
+    FREE(Module, module);
+    module = next;
+  }
+
+  free_objects(vm);
+  vm->globals = NULL;
+  vm->strings = NULL;
+  vm->modules = NULL;
+  vm->objects = NULL;
+
+  FREE_ARRAY(Value, vm->stack, vm->stack_capacity);
+  vm->stack          = NULL;
+  vm->stack_top      = NULL;
+  vm->stack_capacity = 0;
+
+  if(active_vm == vm)
+    active_vm = NULL;
+}
+
+/** @brief The VM bound to the current thread.
+ *
+ * @return The active isolate, or NULL before vm_init has run on this thread.
+ */
+VM *vm_active()
+{
+  return active_vm;
+}
+
+/** @brief Bind a VM to the current thread.
+ *
+ * The modules that cannot carry a VM parameter - the allocator, the
+ * string interner and the compiler's global slot table - operate on
+ * the active isolate. One VM is active per thread at a time.
+ *
+ * @param vm The VM to make active on this thread.
+ */
+void vm_activate(VM *vm)
+{
+  active_vm = vm;
 }
 
 /** @brief Interpret the current code.
@@ -172,77 +345,231 @@ void vm_free()
  * @return The interpret results lets the caller know if there
  * was a compilation error, a runtime error or no error.
  */
-InterpretResult interpret()
+InterpretResult interpret(VM *vm)
 {
   Chunk chunk;
   init_chunk(&chunk);
 
+  // Root the chunk before compiling so a collection triggered during
+  // compilation keeps the strings already stored in its constants alive.
+  vm->chunk = &chunk;
+
   if(!compile(&chunk))
   {
+    vm->chunk = NULL;
     free_chunk(&chunk);
     return INTERPRET_COMPILE_ERROR;
   }
 
+  // Save the bytecode next to the script so the next run of the same
+  // source can skip the compiler. The REPL has no script to cache.
+  const char *script = options_get_script(vm->options);
+  if(script != NULL)
+    cache_store(vm, script, &chunk);
+
+  InterpretResult result = interpret_chunk(vm, &chunk);
+
+  free_chunk(&chunk);
+
+  return result;
+}
+
+/** How many top level declarations each streamed batch compiles
+ * before it runs. One would start output soonest, but every batch
+ * ends with a writer flush and a possible register translation, so a
+ * small batch amortizes that overhead without a noticeable wait for
+ * the first result. */
+#define STREAM_DECLARATIONS 64
+
+/** @brief Compile and run the scanner source in streamed batches.
+ *
+ * Pipelines compilation with execution: batches of top level
+ * declarations are compiled into a pooled chunk and run as soon as
+ * each is ready, so a large script starts producing output before the
+ * compiler reaches the end of the source. The chunk keeps its
+ * capacity and constants across batches, the same arrangement the
+ * REPL uses across lines.
+ *
+ * @param vm The VM to run on.
+ * @return The interpret result of running the source.
+ */
+InterpretResult interpret_stream(VM *vm)
+{
+  Chunk chunk;
+  init_chunk(&chunk);
+
+  // Root the chunk before compiling so a collection triggered during
+  // compilation keeps the strings already stored in its constants alive.
+  vm->chunk = &chunk;
+
+  compile_begin(&chunk);
+
+  InterpretResult result = INTERPRET_OK;
+  bool more = true;
+  while(more)
+  {
+    chunk_reset(&chunk);
+    if(!compile_step(&chunk, STREAM_DECLARATIONS, &more))
+    {
+      result = INTERPRET_COMPILE_ERROR;
+      break;
+    }
+
+    result = interpret_chunk(vm, &chunk);
+
+    // Keep the chunk rooted while the next batch compiles: the
+    // constants carry over and compilation can trigger a collection.
+    vm->chunk = &chunk;
+
+    if(result != INTERPRET_OK)
+      break;
+  }
+
+  compile_end();
+
+  vm->chunk = NULL;
+  free_chunk(&chunk);
+
+  return result;
+}
+
+/** @brief Compile and run one REPL line in a pooled chunk.
+ *
+ * Compiles the current scanner source into the caller's chunk, which
+ * is reset but keeps its capacity and constants across calls, so a
+ * session of many small lines reuses one set of arrays instead of
+ * allocating and freeing them per line.
+ *
+ * @param vm The VM to run on.
+ * @param chunk The pooled chunk owned by the REPL loop.
+ * @return The interpret result of running the line.
+ */
+InterpretResult interpret_line(VM *vm, Chunk *chunk)
+{
+  chunk_reset(chunk);
+
+  // Root the chunk before compiling so a collection triggered during
+  // compilation keeps the strings already stored in its constants alive.
+  vm->chunk = chunk;
+
+  InterpretResult result = INTERPRET_COMPILE_ERROR;
+  if(compile(chunk))
+    result = interpret_chunk(vm, chunk);
+
+  // The chunk stays rooted between lines: its constants carry over,
+  // and a collection can trigger while the next line's source buffer
+  // is allocated.
+  vm->chunk = chunk;
+
+  return result;
+}
+
+/** @brief Run an already compiled chunk.
+ *
+ * Execute a chunk that is ready to run, whether it was just compiled
+ * or loaded from the bytecode cache. Shows the bytecode first when
+ * the dump option is set.
+ *
+ * @param chunk The chunk to execute.
+ * @return The interpret result of running the code.
+ */
+InterpretResult interpret_chunk(VM *vm, Chunk *chunk)
+{
   // If the dump code flag is set show the bytecode.
-  if(options_get_show_code(vm.options))
+  if(options_get_show_code(vm->options))
   {
-    disassemble_chunk(&chunk, "code");
+    disassemble_chunk(chunk, "code");
   }
 
-  vm.chunk = &chunk;
-  vm.ip    = vm.chunk->code;
+  vm->chunk = chunk;
+  vm->ip    = vm->chunk->code;
 
-  InterpretResult result = run();
+  // Imports point vm->chunk at the module being run, so pin the top
+  // level chunk separately to keep its constants marked throughout.
+  vm->script_chunk = chunk;
 
-  free_chunk(&chunk);
+  // The register backend is opt in, and always safe to ask for: a
+  // chunk the translator does not cover runs on the stack loop as
+  // before.
+  if(options_get_registers(vm->options))
+  {
+    RegChunk reg;
+    if(register_translate(chunk, &reg))
+    {
+      InterpretResult result = run_registers(vm, &reg);
+      register_free(&reg);
+
+      writer_flush();
+      vm->chunk        = NULL;
+      vm->script_chunk = NULL;
+
+      return result;
+    }
+  }
+
+#ifdef PROFILE
+  if(options_get_profile(vm->options))
+    profile_begin();
+#endif
+
+  InterpretResult result = run(vm);
+
+  writer_flush();
+  vm->chunk        = NULL;
+  vm->script_chunk = NULL;
 
   return result;
 }
 
-/** @brief Push an object onto the stack.
+/** @brief Push a value onto the stack.
  *
- * Places an object at the top of the runtime stack.
+ * Places a value at the top of the runtime stack.
  *
- * @param object The object to put on the stack.
+ * @param value The value to put on the stack.
  */
-void push(Object *object)
+void push(VM *vm, Value value)
 {
-  *vm.stack_top = object;
-  vm.stack_top++;
+  *vm->stack_top = value;
+  vm->stack_top++;
+
+  // Growing after the store keeps one slot free at all times, so the
+  // pushed value is already a GC root if the reallocation collects.
+  if(vm->stack_top == vm->stack + vm->stack_capacity)
+    grow_stack(vm);
 }
 
-/** @brief Remove an object from the stack.
+/** @brief Remove a value from the stack.
  *
- * Removes and returns the top object from the runtime stack.
+ * Removes and returns the top value from the runtime stack.
  *
- * @return The top Object from the stack.
+ * @return The top Value from the stack.
  */
-Object *pop()
+Value pop(VM *vm)
 {
-  vm.stack_top--;
-  return *vm.stack_top;
+  vm->stack_top--;
+  return *vm->stack_top;
 }
 
-/** @brief Peek at an object in the stack.
+/** @brief Peek at a value in the stack.
  *
- * Returns but does not remove an object at distance offset
+ * Returns but does not remove a value at distance offset
  * from the top of the stack.
  *
  * @param distance The distance from the top of the stack to look at.
- * @return The object found in the stack.
+ * @return The value found in the stack.
  */
-static Object *peek(int distance)
+static Value peek(VM *vm, int distance)
 {
-  return vm.stack_top[-1 - distance];
+  return vm->stack_top[-1 - distance];
 }
 
 /** @brief Release the linked list of objects from the VM.
  *
  * Free the memory for all of the object linked in vm.objects.
  */
-static void free_objects()
+static void free_objects(VM *vm)
 {
-  Object *object = vm.objects;
+  Object *object = vm->objects;
   while(object != NULL)
   {
     Object *next = object->next;
@@ -251,6 +578,170 @@ static void free_objects()
   }
 }
 
+/** @brief Find the name bound to a global slot.
+ *
+ * Walks the global name table looking for the entry whose slot index
+ * matches. Only used to build error messages, so the linear scan is
+ * fine.
+ *
+ * @param slot The global slot index to look up.
+ * @return The variable name, or "?" if the slot has no name.
+ */
+static const char *global_name(VM *vm, int slot)
+{
+  for(int i = 0; i < vm->globals->capacity; i++)
+  {
+    Entry *e = &vm->globals->entries[i];
+    if(IS_STRING(e->key) && AS_INTEGER(e->value) == (long)slot)
+      return AS_CSTRING(e->key);
+  }
+
+  return "?";
+}
+
+/** @brief Resolve a module path against the file that imports it.
+ *
+ * A relative import names a file next to the importing source, not
+ * next to wherever the process happens to be running. The importer is
+ * the module whose chunk is currently executing when the import is
+ * nested, otherwise the script from the command line. An absolute
+ * path, or an import typed at the REPL, is used as given.
+ *
+ * @param vm The VM performing the import.
+ * @param path The path as written in the import statement.
+ * @return The resolved path, interned like any other string.
+ */
+static ObjectString *resolve_module_path(VM *vm, ObjectString *path)
+{
+  if(path->length > 0 && path->chars[0] == '/')
+    return path;
+
+  const char *base = NULL;
+  for(Module *module = vm->modules; module != NULL; module = module->next)
+  {
+    if(&module->chunk == vm->chunk)
+    {
+      base = module->path->chars;
+      break;
+    }
+  }
+  if(base == NULL)
+    base = options_get_script(vm->options);
+
+  // The REPL has no importing file; resolve against the working
+  // directory as before. The same goes for an importer with no
+  // directory part.
+  if(base == NULL)
+    return path;
+
+  const char *slash = strrchr(base, '/');
+  if(slash == NULL)
+    return path;
+
+  int dir_length = (int)(slash - base) + 1;
+  int length     = dir_length + path->length;
+
+  char *joined = ALLOC(char, length + 1);
+  memcpy(joined, base, dir_length);
+  memcpy(joined + dir_length, path->chars, path->length);
+  joined[length] = '\0';
+
+  ObjectString *resolved = copy_string(joined, length);
+  FREE_ARRAY(char, joined, length + 1);
+
+  return resolved;
+}
+
+/** @brief Load and run an imported module.
+ *
+ * Looks the path up in the module registry first. A path that is
+ * already registered was loaded by an earlier import and its chunk is
+ * shared by reference, so the import is a no-op. Otherwise the file
+ * is compiled into a new resident chunk, registered, and its body is
+ * run once in place of the importing chunk, on its own frame so its
+ * local slots do not land in the importer's.
+ *
+ * @param vm The VM to run the module on.
+ * @param path The file path of the module to import.
+ * @return The interpret result of loading and running the module.
+ */
+static InterpretResult import_module(VM *vm, ObjectString *path)
+{
+  // Resolution happens before the registry scan so the same module
+  // imported from two directories still loads once. The resolved path
+  // may be a fresh string; it rides on the stack until the module
+  // registry holds it.
+  path = resolve_module_path(vm, path);
+  push(vm, create_object((Object*)path));
+
+  // A registered module, including one whose body is still running,
+  // is shared by reference and never run a second time. This keeps
+  // a diamond of imports from redefining globals and breaks import
+  // cycles.
+  for(Module *found = vm->modules; found != NULL; found = found->next)
+  {
+    if(found->path->length == path->length
+      && memcmp(found->path->chars, path->chars, path->length) == 0)
+    {
+      pop(vm);
+      return INTERPRET_OK;
+    }
+  }
+
+  // The source module treats a missing file as fatal, so catch it
+  // here and report an ordinary runtime error instead.
+  FILE *file = fopen(path->chars, "r");
+  if(file == NULL)
+  {
+    runtime_error(vm, "Could not open module '%s'.", path->chars);
+    return INTERPRET_RUNTIME_ERROR;
+  }
+  fclose(file);
+
+  Module *module = ALLOC(Module, 1);
+  module->path = path;
+  init_chunk(&module->chunk);
+
+  // Register the module before compiling so a collection triggered
+  // during compilation keeps the constants already stored in its
+  // chunk alive.
+  module->next = vm->modules;
+  vm->modules  = module;
+
+  // The registry roots the path from here on.
+  pop(vm);
+
+  // The compiler is idle while the VM runs, so it can be reused here
+  // to compile the module source lazily on the first import.
+  add_source_file(path->chars);
+  if(!compile(&module->chunk))
+  {
+    runtime_error(vm, "Could not compile module '%s'.", path->chars);
+    return INTERPRET_RUNTIME_ERROR;
+  }
+
+  // Run the module body where the import appeared, then pick the
+  // importing chunk back up where it left off. The module's local
+  // slots are numbered from zero, so its frame starts at the current
+  // stack top; the caller's frame is kept as an offset because the
+  // stack array can move while the module runs.
+  Chunk *caller_chunk = vm->chunk;
+  Byte *caller_ip     = vm->ip;
+  long caller_frame   = vm->frame - vm->stack;
+
+  vm->chunk = &module->chunk;
+  vm->ip    = vm->chunk->code;
+  vm->frame = vm->stack_top;
+
+  InterpretResult result = run(vm);
+
+  vm->chunk = caller_chunk;
+  vm->ip    = caller_ip;
+  vm->frame = vm->stack + caller_frame;
+
+  return result;
+}
+
 /**
  * Validate that the top two operands on the stack are
  * valid with the `validator` macro. If not, display the
@@ -258,9 +749,9 @@ static void free_objects()
  */
 #define VALIDATE_BINARY_OPERANDS(validator, message) \
   do {\
-    if(!validator(peek(0)) || !validator(peek(1)))\
+    if(!validator(peek(vm, 0)) || !validator(peek(vm, 1)))\
     {\
-      runtime_error(message);\
+      runtime_error(vm, message);\
       return INTERPRET_RUNTIME_ERROR;\
     }\
   } while(false)
@@ -271,192 +762,976 @@ static void free_objects()
  */
 #define VALIDATE_UNARY_OPERAND(validator, message)\
   do {\
-    if(!validator(peek(0)))\
+    if(!validator(peek(vm, 0)))\
     {\
-      runtime_error(message);\
+      runtime_error(vm, message);\
       return INTERPRET_RUNTIME_ERROR;\
     }\
   } while(false)
 
 /** @brief Run the code in the Chunk array.
  *
- * The run() function cycles through all the the OpCodes in the Chunk array
+ * The run(vm) function cycles through all the the OpCodes in the Chunk array
  * and performs the necessary actions.
  *
  * @return The InterpretResult of running the code.
  */
-static InterpretResult run()
+static InterpretResult run(VM *vm)
+{
+#define READ_BYTE() (*vm->ip++)
+#define READ_SHORT() (vm->ip += 2, (uint16_t)((vm->ip[-2] << 8) | vm->ip[-1]))
+#define READ_LONG() (vm->ip += 3, (int)((vm->ip[-3] << 16) | (vm->ip[-2] << 8) | vm->ip[-1]))
+#define READ_CONSTANT() (vm->chunk->constants.values[READ_BYTE()])
+
+#ifdef PROFILE
+  // In a profiling build every dispatch funnels through profile_step
+  // so the profiler can attribute time to the instruction that just
+  // finished and count the one about to run.
+#define NEXT_CODE() (profile_enabled() ? profile_step() : READ_BYTE())
+#else
+#define NEXT_CODE() READ_BYTE()
+#endif
+
+#ifdef THREADED_DISPATCH
+  // Computed goto dispatch. Each opcode jumps directly to the handler for
+  // the next opcode, which gives the branch predictor one indirect branch
+  // per handler instead of a single shared one for the whole loop.
+  static void *dispatch_table[] = {
+    [OP_CONSTANT]      = &&code_OP_CONSTANT,
+    [OP_POP]           = &&code_OP_POP,
+    [OP_NIL]           = &&code_OP_NIL,
+    [OP_TRUE]          = &&code_OP_TRUE,
+    [OP_FALSE]         = &&code_OP_FALSE,
+    [OP_GET_LOCAL]     = &&code_OP_GET_LOCAL,
+    [OP_SET_LOCAL]     = &&code_OP_SET_LOCAL,
+    [OP_GET_GLOBAL]    = &&code_OP_GET_GLOBAL,
+    [OP_DEFINE_GLOBAL] = &&code_OP_DEFINE_GLOBAL,
+    [OP_SET_GLOBAL]    = &&code_OP_SET_GLOBAL,
+    [OP_EQUAL]         = &&code_OP_EQUAL,
+    [OP_GREATER]       = &&code_OP_GREATER,
+    [OP_LESS]          = &&code_OP_LESS,
+    [OP_ADD]           = &&code_OP_ADD,
+    [OP_SUBTRACT]      = &&code_OP_SUBTRACT,
+    [OP_MULTIPLY]      = &&code_OP_MULTIPLY,
+    [OP_DIVIDE]        = &&code_OP_DIVIDE,
+    [OP_MODULUS]       = &&code_OP_MODULUS,
+    [OP_POWER]         = &&code_OP_POWER,
+    [OP_NOT]           = &&code_OP_NOT,
+    [OP_NEGATE]        = &&code_OP_NEGATE,
+    [OP_PRINT]         = &&code_OP_PRINT,
+    [OP_JUMP]          = &&code_OP_JUMP,
+    [OP_JUMP_IF_FALSE] = &&code_OP_JUMP_IF_FALSE,
+    [OP_LOOP]          = &&code_OP_LOOP,
+    [OP_ADD_CONST]                 = &&code_OP_ADD_CONST,
+    [OP_SUBTRACT_CONST]            = &&code_OP_SUBTRACT_CONST,
+    [OP_LESS_CONST]                = &&code_OP_LESS_CONST,
+    [OP_GREATER_CONST]             = &&code_OP_GREATER_CONST,
+    [OP_JUMP_IF_NOT_LESS]          = &&code_OP_JUMP_IF_NOT_LESS,
+    [OP_JUMP_IF_NOT_GREATER]       = &&code_OP_JUMP_IF_NOT_GREATER,
+    [OP_JUMP_IF_NOT_LESS_CONST]    = &&code_OP_JUMP_IF_NOT_LESS_CONST,
+    [OP_JUMP_IF_NOT_GREATER_CONST] = &&code_OP_JUMP_IF_NOT_GREATER_CONST,
+    [OP_ADD_INT]       = &&code_OP_ADD_INT,
+    [OP_ADD_REAL]      = &&code_OP_ADD_REAL,
+    [OP_SUBTRACT_INT]  = &&code_OP_SUBTRACT_INT,
+    [OP_SUBTRACT_REAL] = &&code_OP_SUBTRACT_REAL,
+    [OP_MULTIPLY_INT]  = &&code_OP_MULTIPLY_INT,
+    [OP_MULTIPLY_REAL] = &&code_OP_MULTIPLY_REAL,
+    [OP_CONCAT_N]      = &&code_OP_CONCAT_N,
+    [OP_CONSTANT_LONG]      = &&code_OP_CONSTANT_LONG,
+    [OP_GET_LOCAL_LONG]     = &&code_OP_GET_LOCAL_LONG,
+    [OP_SET_LOCAL_LONG]     = &&code_OP_SET_LOCAL_LONG,
+    [OP_GET_GLOBAL_LONG]    = &&code_OP_GET_GLOBAL_LONG,
+    [OP_DEFINE_GLOBAL_LONG] = &&code_OP_DEFINE_GLOBAL_LONG,
+    [OP_SET_GLOBAL_LONG]    = &&code_OP_SET_GLOBAL_LONG,
+    [OP_IMPORT]        = &&code_OP_IMPORT,
+    [OP_RETURN]        = &&code_OP_RETURN,
+  };
+
+#define INTERPRET_LOOP DISPATCH();
+#define CASE_CODE(code) code_##code
+#define DISPATCH() goto *dispatch_table[NEXT_CODE()]
+#else
+#define INTERPRET_LOOP dispatch: switch(NEXT_CODE())
+#define CASE_CODE(code) case code
+#define DISPATCH() goto dispatch
+#endif
+
+  INTERPRET_LOOP
+  {
+    CASE_CODE(OP_CONSTANT):
+    {
+      Value constant = READ_CONSTANT();
+      push(vm, constant);
+      DISPATCH();
+    }
+    CASE_CODE(OP_POP):
+    {
+      pop(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_NIL):
+    {
+      push(vm, create_nil());
+      DISPATCH();
+    }
+    CASE_CODE(OP_TRUE):
+    {
+      push(vm, create_boolean(true));
+      DISPATCH();
+    }
+    CASE_CODE(OP_FALSE):
+    {
+      push(vm, create_boolean(false));
+      DISPATCH();
+    }
+    CASE_CODE(OP_GET_LOCAL):
+    {
+      Byte slot = READ_BYTE();
+      push(vm, vm->frame[slot]);
+      DISPATCH();
+    }
+    CASE_CODE(OP_SET_LOCAL):
+    {
+      Byte slot = READ_BYTE();
+      vm->frame[slot] = peek(vm, 0);
+      DISPATCH();
+    }
+    CASE_CODE(OP_GET_GLOBAL):
+    {
+      Byte slot = READ_BYTE();
+      Value value = vm->global_slots.values[slot];
+      if(IS_UNDEFINED(value))
+      {
+        runtime_error(vm, "Undefined variable '%s'.", global_name(vm, slot));
+        return INTERPRET_RUNTIME_ERROR;
+      }
+      push(vm, value);
+      DISPATCH();
+    }
+    CASE_CODE(OP_DEFINE_GLOBAL):
+    {
+      Byte slot = READ_BYTE();
+      vm->global_slots.values[slot] = peek(vm, 0);
+      pop(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_SET_GLOBAL):
+    {
+      Byte slot = READ_BYTE();
+      vm->global_slots.values[slot] = peek(vm, 0);
+      DISPATCH();
+    }
+    CASE_CODE(OP_EQUAL):
+    {
+      Value b = pop(vm);
+      Value a = pop(vm);
+      push(vm, create_boolean(values_equal(a, b)));
+      DISPATCH();
+    }
+    CASE_CODE(OP_GREATER):
+    {
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
+      do_greater(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_LESS):
+    {
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numberic.");
+      do_less(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_ADD):
+    {
+      if(IS_STRING(peek(vm, 0)) && IS_STRING(peek(vm, 1)))
+        do_concatenate(vm);
+      else if(IS_NUMBER(peek(vm, 0)) && IS_NUMBER(peek(vm, 1)))
+      {
+        // Quicken the site now that the operand types are known. A
+        // mixed integer and real addition stays generic.
+        if(IS_INTEGER(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
+          vm->ip[-1] = OP_ADD_INT;
+        else if(IS_REAL(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
+          vm->ip[-1] = OP_ADD_REAL;
+        do_addition(vm);
+      }
+      else
+      {
+        runtime_error(vm, "Operands must be two numbers or two strings.");
+        return INTERPRET_RUNTIME_ERROR;
+      }
+      DISPATCH();
+    }
+    CASE_CODE(OP_SUBTRACT):
+    {
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
+      if(IS_INTEGER(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
+        vm->ip[-1] = OP_SUBTRACT_INT;
+      else if(IS_REAL(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
+        vm->ip[-1] = OP_SUBTRACT_REAL;
+      do_subtraction(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_MULTIPLY):
+    {
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
+      if(IS_INTEGER(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
+        vm->ip[-1] = OP_MULTIPLY_INT;
+      else if(IS_REAL(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
+        vm->ip[-1] = OP_MULTIPLY_REAL;
+      do_multiplication(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_DIVIDE):
+    {
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
+      // Check for divide by zero runtime error.
+      if(IS_INTEGER(peek(vm, 0)) && AS_INTEGER(peek(vm, 0)) == 0)
+      {
+        runtime_error(vm, "Attempt to divide by zero.");
+        return INTERPRET_RUNTIME_ERROR;
+      }
+      if(IS_REAL(peek(vm, 0)) && AS_REAL(peek(vm, 0)) == 0)
+      {
+        runtime_error(vm, "Attempt to divide by zero.");
+        return INTERPRET_RUNTIME_ERROR;
+      }
+      do_division(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_MODULUS):
+    {
+      VALIDATE_BINARY_OPERANDS(IS_INTEGER, "Modulo operation can only be performed on integer values.");
+      do_modulo(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_POWER):
+    {
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
+      do_power(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_NOT):
+    {
+      push(vm, create_boolean(is_falsey(pop(vm))));
+      DISPATCH();
+    }
+    CASE_CODE(OP_NEGATE):
+    {
+      VALIDATE_UNARY_OPERAND(IS_NUMBER, "Operand must be numeric.");
+      do_negate(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_PRINT):
+    {
+      writer_string("-> ", 3);
+      write_value(pop(vm));
+      writer_char('\n');
+      DISPATCH();
+    }
+    CASE_CODE(OP_JUMP):
+    {
+      uint16_t offset = READ_SHORT();
+      vm->ip += offset;
+      DISPATCH();
+    }
+    CASE_CODE(OP_JUMP_IF_FALSE):
+    {
+      uint16_t offset = READ_SHORT();
+      if(is_falsey(peek(vm, 0)))
+        vm->ip += offset;
+      DISPATCH();
+    }
+    CASE_CODE(OP_LOOP):
+    {
+      uint16_t offset = READ_SHORT();
+      vm->ip -= offset;
+      DISPATCH();
+    }
+    CASE_CODE(OP_ADD_CONST):
+    {
+      push(vm, READ_CONSTANT());
+      if(IS_STRING(peek(vm, 0)) && IS_STRING(peek(vm, 1)))
+        do_concatenate(vm);
+      else if(IS_NUMBER(peek(vm, 0)) && IS_NUMBER(peek(vm, 1)))
+        do_addition(vm);
+      else
+      {
+        runtime_error(vm, "Operands must be two numbers or two strings.");
+        return INTERPRET_RUNTIME_ERROR;
+      }
+      DISPATCH();
+    }
+    CASE_CODE(OP_SUBTRACT_CONST):
+    {
+      push(vm, READ_CONSTANT());
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
+      do_subtraction(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_LESS_CONST):
+    {
+      push(vm, READ_CONSTANT());
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numberic.");
+      do_less(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_GREATER_CONST):
+    {
+      push(vm, READ_CONSTANT());
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
+      do_greater(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_JUMP_IF_NOT_LESS):
+    {
+      uint16_t offset = READ_SHORT();
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numberic.");
+      do_less(vm);
+      if(is_falsey(pop(vm)))
+        vm->ip += offset;
+      DISPATCH();
+    }
+    CASE_CODE(OP_JUMP_IF_NOT_GREATER):
+    {
+      uint16_t offset = READ_SHORT();
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
+      do_greater(vm);
+      if(is_falsey(pop(vm)))
+        vm->ip += offset;
+      DISPATCH();
+    }
+    CASE_CODE(OP_JUMP_IF_NOT_LESS_CONST):
+    {
+      push(vm, READ_CONSTANT());
+      uint16_t offset = READ_SHORT();
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numberic.");
+      do_less(vm);
+      if(is_falsey(pop(vm)))
+        vm->ip += offset;
+      DISPATCH();
+    }
+    CASE_CODE(OP_JUMP_IF_NOT_GREATER_CONST):
+    {
+      push(vm, READ_CONSTANT());
+      uint16_t offset = READ_SHORT();
+      VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
+      do_greater(vm);
+      if(is_falsey(pop(vm)))
+        vm->ip += offset;
+      DISPATCH();
+    }
+    CASE_CODE(OP_ADD_INT):
+    {
+      if(!IS_INTEGER(peek(vm, 0)) || !IS_INTEGER(peek(vm, 1)))
+      {
+        // Deoptimize: the site stopped seeing two integers. Restore
+        // the generic opcode and re-dispatch it.
+        vm->ip[-1] = OP_ADD;
+        vm->ip--;
+        DISPATCH();
+      }
+      long b = AS_INTEGER(pop(vm));
+      long a = AS_INTEGER(pop(vm));
+      push(vm, create_integer(a + b));
+      DISPATCH();
+    }
+    CASE_CODE(OP_ADD_REAL):
+    {
+      if(!IS_REAL(peek(vm, 0)) || !IS_REAL(peek(vm, 1)))
+      {
+        vm->ip[-1] = OP_ADD;
+        vm->ip--;
+        DISPATCH();
+      }
+      double b = AS_REAL(pop(vm));
+      double a = AS_REAL(pop(vm));
+      push(vm, create_real(a + b));
+      DISPATCH();
+    }
+    CASE_CODE(OP_SUBTRACT_INT):
+    {
+      if(!IS_INTEGER(peek(vm, 0)) || !IS_INTEGER(peek(vm, 1)))
+      {
+        vm->ip[-1] = OP_SUBTRACT;
+        vm->ip--;
+        DISPATCH();
+      }
+      long b = AS_INTEGER(pop(vm));
+      long a = AS_INTEGER(pop(vm));
+      push(vm, create_integer(a - b));
+      DISPATCH();
+    }
+    CASE_CODE(OP_SUBTRACT_REAL):
+    {
+      if(!IS_REAL(peek(vm, 0)) || !IS_REAL(peek(vm, 1)))
+      {
+        vm->ip[-1] = OP_SUBTRACT;
+        vm->ip--;
+        DISPATCH();
+      }
+      double b = AS_REAL(pop(vm));
+      double a = AS_REAL(pop(vm));
+      push(vm, create_real(a - b));
+      DISPATCH();
+    }
+    CASE_CODE(OP_MULTIPLY_INT):
+    {
+      if(!IS_INTEGER(peek(vm, 0)) || !IS_INTEGER(peek(vm, 1)))
+      {
+        vm->ip[-1] = OP_MULTIPLY;
+        vm->ip--;
+        DISPATCH();
+      }
+      long b = AS_INTEGER(pop(vm));
+      long a = AS_INTEGER(pop(vm));
+      push(vm, create_integer(a * b));
+      DISPATCH();
+    }
+    CASE_CODE(OP_MULTIPLY_REAL):
+    {
+      if(!IS_REAL(peek(vm, 0)) || !IS_REAL(peek(vm, 1)))
+      {
+        vm->ip[-1] = OP_MULTIPLY;
+        vm->ip--;
+        DISPATCH();
+      }
+      double b = AS_REAL(pop(vm));
+      double a = AS_REAL(pop(vm));
+      push(vm, create_real(a * b));
+      DISPATCH();
+    }
+    CASE_CODE(OP_CONCAT_N):
+    {
+      int count = READ_BYTE();
+      Value *base = vm->stack_top - count;
+
+      bool all_strings = true;
+      for(int i = 0; i < count; i++)
+      {
+        if(!IS_STRING(base[i]))
+        {
+          all_strings = false;
+          break;
+        }
+      }
+
+      if(all_strings)
+      {
+        // The pieces stay on the stack while the result is built, so
+        // a collection during the allocation cannot free them. The
+        // rooting push inside concat_strings can grow the stack, so
+        // base is recomputed on the new allocation before it is used.
+        ObjectString *result = concat_strings(base, count);
+        base = vm->stack_top - count;
+        vm->stack_top = base;
+        push(vm, create_object((Object*)result));
+        DISPATCH();
+      }
+
+      // A chain that is not all strings folds left to right with the
+      // same semantics as the run of OP_ADD instructions it replaced.
+      for(int i = 1; i < count; i++)
+      {
+        Value a = base[0];
+        Value b = base[i];
+        if(IS_STRING(a) && IS_STRING(b))
+        {
+          Value pair[2] = { a, b };
+          ObjectString *joined = concat_strings(pair, 2);
+          base = vm->stack_top - count;
+          base[0] = create_object((Object*)joined);
+        }
+        else if(IS_INTEGER(a) && IS_INTEGER(b))
+          base[0] = create_integer(AS_INTEGER(a) + AS_INTEGER(b));
+        else if(IS_NUMBER(a) && IS_NUMBER(b))
+        {
+          double left  = IS_REAL(a) ? AS_REAL(a) : (double)AS_INTEGER(a);
+          double right = IS_REAL(b) ? AS_REAL(b) : (double)AS_INTEGER(b);
+          base[0] = create_real(left + right);
+        }
+        else
+        {
+          runtime_error(vm, "Operands must be two numbers or two strings.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+      }
+
+      vm->stack_top = base + 1;
+      DISPATCH();
+    }
+    CASE_CODE(OP_CONSTANT_LONG):
+    {
+      push(vm, vm->chunk->constants.values[READ_LONG()]);
+      DISPATCH();
+    }
+    CASE_CODE(OP_GET_LOCAL_LONG):
+    {
+      int slot = READ_SHORT();
+      push(vm, vm->frame[slot]);
+      DISPATCH();
+    }
+    CASE_CODE(OP_SET_LOCAL_LONG):
+    {
+      int slot = READ_SHORT();
+      vm->frame[slot] = peek(vm, 0);
+      DISPATCH();
+    }
+    CASE_CODE(OP_GET_GLOBAL_LONG):
+    {
+      int slot = READ_SHORT();
+      Value value = vm->global_slots.values[slot];
+      if(IS_UNDEFINED(value))
+      {
+        runtime_error(vm, "Undefined variable '%s'.", global_name(vm, slot));
+        return INTERPRET_RUNTIME_ERROR;
+      }
+      push(vm, value);
+      DISPATCH();
+    }
+    CASE_CODE(OP_DEFINE_GLOBAL_LONG):
+    {
+      int slot = READ_SHORT();
+      vm->global_slots.values[slot] = peek(vm, 0);
+      pop(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_SET_GLOBAL_LONG):
+    {
+      int slot = READ_SHORT();
+      vm->global_slots.values[slot] = peek(vm, 0);
+      DISPATCH();
+    }
+    CASE_CODE(OP_IMPORT):
+    {
+      // The path stays on the stack during the import so it is rooted
+      // while the module compiles and runs.
+      InterpretResult result = import_module(vm, AS_STRING(peek(vm, 0)));
+      if(result != INTERPRET_OK)
+        return result;
+      pop(vm);
+      DISPATCH();
+    }
+    CASE_CODE(OP_RETURN):
+    {
+      return INTERPRET_OK;
+    }
+  }
+
+  // Not reachable: every handler above either dispatches or returns.
+  DISPATCH();
+
+#undef INTERPRET_LOOP
+#undef CASE_CODE
+#undef DISPATCH
+#undef NEXT_CODE
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_LONG
+#undef READ_CONSTANT
+}
+
+/** Validate two register operands with the `validator` macro. If
+ * either fails, display the runtime error message and return an
+ * error.
+ */
+#define VALIDATE_REG_OPERANDS(validator, a, b, message) \
+  do {\
+    if(!validator(a) || !validator(b))\
+    {\
+      register_error(vm, reg, ip, message);\
+      return INTERPRET_RUNTIME_ERROR;\
+    }\
+  } while(false)
+
+/** @brief Run translated register code.
+ *
+ * The parallel executor for the register backend. The register file is
+ * the bottom of the value stack, so locals sit in the same slots the
+ * stack loop would use and the collector roots the registers for free.
+ *
+ * @param vm The VM to run on.
+ * @param reg The translated register chunk to execute.
+ * @return The InterpretResult of running the code.
+ */
+static InterpretResult run_registers(VM *vm, RegChunk *reg)
 {
-#define READ_BYTE() (*vm.ip++)
-#define READ_SHORT() (vm.ip += 2, (uint16_t)((vm.ip[-2] << 8) | vm.ip[-1]))
-#define READ_CONSTANT() (vm.chunk->constants.objects[READ_BYTE()])
-#define READ_STRING() AS_STRING(READ_CONSTANT())
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+#define CONSTANT(index) (reg->constants->values[index])
+
+  // Keep one slot free beyond the register file so an import can push
+  // on top of it, exactly like push maintains for the stack loop.
+  while(vm->stack_capacity < reg->registers + 1)
+    grow_stack(vm);
+
+  Value *r = vm->stack;
+  for(int i = 0; i < reg->registers; i++)
+    r[i] = create_nil();
+
+  // Rooting the whole register file keeps every live register marked,
+  // at worst holding a dead temporary until its slot is reused.
+  vm->stack_top = vm->stack + reg->registers;
+
+  Byte *ip = reg->code;
 
   for(;;)
   {
-    Byte instruction;
-    switch(instruction = READ_BYTE())
+    switch(READ_BYTE())
     {
-      case OP_CONSTANT:
+      case REG_LOAD_CONST:
       {
-        Object *constant = READ_CONSTANT();
-        push(constant);
+        Byte dst = READ_BYTE();
+        r[dst] = CONSTANT(READ_BYTE());
         break;
       }
-      case OP_POP:
+      case REG_LOAD_NIL:
+        r[READ_BYTE()] = create_nil();
+        break;
+      case REG_LOAD_TRUE:
+        r[READ_BYTE()] = create_boolean(true);
+        break;
+      case REG_LOAD_FALSE:
+        r[READ_BYTE()] = create_boolean(false);
+        break;
+      case REG_MOVE:
       {
-        pop();
+        Byte dst = READ_BYTE();
+        r[dst] = r[READ_BYTE()];
         break;
       }
-      case OP_GET_LOCAL:
+      case REG_GET_GLOBAL:
       {
-        Byte slot = READ_BYTE();
-        push(vm.stack[slot]);
+        Byte dst = READ_BYTE();
+        int slot = READ_SHORT();
+        Value value = vm->global_slots.values[slot];
+        if(IS_UNDEFINED(value))
+        {
+          register_error(vm, reg, ip, "Undefined variable '%s'.", global_name(vm, slot));
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        r[dst] = value;
         break;
       }
-      case OP_SET_LOCAL:
+      case REG_SET_GLOBAL:
+      case REG_DEFINE_GLOBAL:
       {
-        Byte slot = READ_BYTE();
-        vm.stack[slot] = peek(0);
+        int slot = READ_SHORT();
+        vm->global_slots.values[slot] = r[READ_BYTE()];
         break;
       }
-      case OP_GET_GLOBAL:
+      case REG_ADD:
       {
-        ObjectString *name = READ_STRING();
-        Object *value = table_search(vm.globals, AS_OBJECT(name));
-        if(value == NULL)
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = r[READ_BYTE()];
+        if(IS_STRING(a) && IS_STRING(b))
         {
-          runtime_error("Undefined variable '%s'.", name->chars);
+          // The operands stay rooted in their registers while the
+          // result is allocated. The rooting push inside
+          // concat_strings can grow the stack, so the register file
+          // is rebased before the store, like REG_IMPORT does.
+          Value pair[2] = { a, b };
+          ObjectString *joined = concat_strings(pair, 2);
+          r = vm->stack;
+          r[dst] = create_object((Object*)joined);
+        }
+        else if(IS_NUMBER(a) && IS_NUMBER(b))
+          r[dst] = value_add(a, b);
+        else
+        {
+          register_error(vm, reg, ip, "Operands must be two numbers or two strings.");
           return INTERPRET_RUNTIME_ERROR;
         }
-        push(value);
         break;
       }
-      case OP_DEFINE_GLOBAL:
+      case REG_SUBTRACT:
       {
-        ObjectString *name = READ_STRING();
-        table_insert(vm.globals, AS_OBJECT(name), peek(0));
-        pop();
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = r[READ_BYTE()];
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numeric.");
+        r[dst] = value_subtract(a, b);
         break;
       }
-      case OP_SET_GLOBAL:
+      case REG_MULTIPLY:
       {
-        ObjectString *name = READ_STRING();
-        table_insert(vm.globals, AS_OBJECT(name), peek(0));
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = r[READ_BYTE()];
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numeric.");
+        r[dst] = value_multiply(a, b);
         break;
       }
-      case OP_EQUAL:
+      case REG_DIVIDE:
       {
-        Object *b = pop();
-        Object *a = pop();
-        push(AS_OBJECT(create_boolean(objects_equal(a, b))));
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = r[READ_BYTE()];
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numeric.");
+        if((IS_INTEGER(b) && AS_INTEGER(b) == 0) || (IS_REAL(b) && AS_REAL(b) == 0))
+        {
+          register_error(vm, reg, ip, "Attempt to divide by zero.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        r[dst] = value_divide(a, b);
+        break;
+      }
+      case REG_MODULUS:
+      {
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = r[READ_BYTE()];
+        VALIDATE_REG_OPERANDS(IS_INTEGER, a, b, "Modulo operation can only be performed on integer values.");
+        r[dst] = create_integer(AS_INTEGER(a) % AS_INTEGER(b));
+        break;
+      }
+      case REG_POWER:
+      {
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = r[READ_BYTE()];
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numeric.");
+        r[dst] = value_power(a, b);
         break;
       }
-      case OP_GREATER:
+      case REG_EQUAL:
       {
-        VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
-        do_greater();
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = r[READ_BYTE()];
+        r[dst] = create_boolean(values_equal(a, b));
         break;
       }
-      case OP_LESS:
+      case REG_GREATER:
       {
-        VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numberic.");
-        do_less();
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = r[READ_BYTE()];
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numeric.");
+        r[dst] = create_boolean(value_greater(a, b));
         break;
       }
-      case OP_ADD:
+      case REG_LESS:
       {
-        if(IS_STRING(peek(0)) && IS_STRING(peek(1)))
-          do_concatenate();
-        else if(IS_NUMBER(peek(0)) && IS_NUMBER(peek(1)))
-          do_addition();
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = r[READ_BYTE()];
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numberic.");
+        r[dst] = create_boolean(value_less(a, b));
+        break;
+      }
+      case REG_ADD_C:
+      {
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = CONSTANT(READ_BYTE());
+        if(IS_STRING(a) && IS_STRING(b))
+        {
+          Value pair[2] = { a, b };
+          ObjectString *joined = concat_strings(pair, 2);
+          r = vm->stack;
+          r[dst] = create_object((Object*)joined);
+        }
+        else if(IS_NUMBER(a) && IS_NUMBER(b))
+          r[dst] = value_add(a, b);
         else
         {
-          runtime_error("Operands must be two numbers or two strings.");
+          register_error(vm, reg, ip, "Operands must be two numbers or two strings.");
           return INTERPRET_RUNTIME_ERROR;
         }
         break;
       }
-      case OP_SUBTRACT:
+      case REG_SUBTRACT_C:
       {
-        VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
-        do_subtraction();
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = CONSTANT(READ_BYTE());
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numeric.");
+        r[dst] = value_subtract(a, b);
         break;
       }
-      case OP_MULTIPLY:
+      case REG_MULTIPLY_C:
       {
-        VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
-        do_multiplication();
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = CONSTANT(READ_BYTE());
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numeric.");
+        r[dst] = value_multiply(a, b);
         break;
       }
-      case OP_DIVIDE:
+      case REG_GREATER_C:
       {
-        VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
-        // Check for divide by zero runtime error.
-        if(IS_INTEGER(peek(0)) && AS_INTEGER(peek(0)) == 0)
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = CONSTANT(READ_BYTE());
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numeric.");
+        r[dst] = create_boolean(value_greater(a, b));
+        break;
+      }
+      case REG_LESS_C:
+      {
+        Byte dst = READ_BYTE();
+        Value a = r[READ_BYTE()];
+        Value b = CONSTANT(READ_BYTE());
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numberic.");
+        r[dst] = create_boolean(value_less(a, b));
+        break;
+      }
+      case REG_NOT:
+      {
+        Byte dst = READ_BYTE();
+        r[dst] = create_boolean(is_falsey(r[READ_BYTE()]));
+        break;
+      }
+      case REG_NEGATE:
+      {
+        Byte dst = READ_BYTE();
+        Value v = r[READ_BYTE()];
+        if(!IS_NUMBER(v))
         {
-          runtime_error("Attempt to divide by zero.");
+          register_error(vm, reg, ip, "Operand must be numeric.");
           return INTERPRET_RUNTIME_ERROR;
         }
-        if(IS_REAL(peek(0)) && AS_REAL(peek(0)) == 0)
+        r[dst] = IS_INTEGER(v) ? create_integer(-AS_INTEGER(v)) : create_real(-AS_REAL(v));
+        break;
+      }
+      case REG_PRINT:
+      {
+        writer_string("-> ", 3);
+        write_value(r[READ_BYTE()]);
+        writer_char('\n');
+        break;
+      }
+      case REG_CONCAT_N:
+      {
+        Byte first = READ_BYTE();
+        int count = READ_BYTE();
+        Value *base = r + first;
+
+        bool all_strings = true;
+        for(int i = 0; i < count; i++)
+        {
+          if(!IS_STRING(base[i]))
+          {
+            all_strings = false;
+            break;
+          }
+        }
+
+        if(all_strings)
         {
-          runtime_error("Attempt to divide by zero.");
-          return INTERPRET_RUNTIME_ERROR;
+          // The pieces stay rooted in their registers while the
+          // result is built.
+          ObjectString *joined = concat_strings(base, count);
+          r = vm->stack;
+          base = r + first;
+          base[0] = create_object((Object*)joined);
+          break;
+        }
+
+        // A chain that is not all strings folds left to right, same
+        // as the stack loop.
+        for(int i = 1; i < count; i++)
+        {
+          Value a = base[0];
+          Value b = base[i];
+          if(IS_STRING(a) && IS_STRING(b))
+          {
+            Value pair[2] = { a, b };
+            ObjectString *joined = concat_strings(pair, 2);
+            r = vm->stack;
+            base = r + first;
+            base[0] = create_object((Object*)joined);
+          }
+          else if(IS_INTEGER(a) && IS_INTEGER(b))
+            base[0] = create_integer(AS_INTEGER(a) + AS_INTEGER(b));
+          else if(IS_NUMBER(a) && IS_NUMBER(b))
+          {
+            double left  = IS_REAL(a) ? AS_REAL(a) : (double)AS_INTEGER(a);
+            double right = IS_REAL(b) ? AS_REAL(b) : (double)AS_INTEGER(b);
+            base[0] = create_real(left + right);
+          }
+          else
+          {
+            register_error(vm, reg, ip, "Operands must be two numbers or two strings.");
+            return INTERPRET_RUNTIME_ERROR;
+          }
         }
-        do_division();
         break;
       }
-      case OP_MODULUS:
+      case REG_IMPORT:
       {
-        VALIDATE_BINARY_OPERANDS(IS_INTEGER, "Modulo operation can only be performed on integer values.");
-        do_modulo();
+        InterpretResult result = import_module(vm, AS_STRING(r[READ_BYTE()]));
+        if(result != INTERPRET_OK)
+          return result;
+        // The module ran on the stack loop above the register file
+        // and may have grown the stack, so rebase the register file.
+        r = vm->stack;
         break;
       }
-      case OP_POWER:
+      case REG_JUMP:
       {
-        VALIDATE_BINARY_OPERANDS(IS_NUMBER, "Operands must be numeric.");
-        do_power();
+        uint16_t offset = READ_SHORT();
+        ip += offset;
         break;
       }
-      case OP_NOT:
+      case REG_JUMP_IF_FALSE:
       {
-        push(AS_OBJECT(create_boolean(is_falsey(pop()))));
+        Value v = r[READ_BYTE()];
+        uint16_t offset = READ_SHORT();
+        if(is_falsey(v))
+          ip += offset;
         break;
       }
-      case OP_NEGATE:
+      case REG_JUMP_IF_NOT_LESS:
       {
-        VALIDATE_UNARY_OPERAND(IS_NUMBER, "Operand must be numeric.");
-        do_negate();
+        Value a = r[READ_BYTE()];
+        Value b = r[READ_BYTE()];
+        uint16_t offset = READ_SHORT();
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numberic.");
+        if(!value_less(a, b))
+          ip += offset;
         break;
       }
-      case OP_PRINT:
+      case REG_JUMP_IF_NOT_GREATER:
       {
-        printf("-> ");
-        print_object(pop());
-        printf("\n");
+        Value a = r[READ_BYTE()];
+        Value b = r[READ_BYTE()];
+        uint16_t offset = READ_SHORT();
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numeric.");
+        if(!value_greater(a, b))
+          ip += offset;
         break;
       }
-      case OP_JUMP:
+      case REG_JUMP_IF_NOT_LESS_C:
       {
+        Value a = r[READ_BYTE()];
+        Value b = CONSTANT(READ_BYTE());
         uint16_t offset = READ_SHORT();
-        vm.ip += offset;
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numberic.");
+        if(!value_less(a, b))
+          ip += offset;
         break;
       }
-      case OP_JUMP_IF_FALSE:
+      case REG_JUMP_IF_NOT_GREATER_C:
       {
+        Value a = r[READ_BYTE()];
+        Value b = CONSTANT(READ_BYTE());
         uint16_t offset = READ_SHORT();
-        if(is_falsey(peek(0)))
-          vm.ip += offset;
+        VALIDATE_REG_OPERANDS(IS_NUMBER, a, b, "Operands must be numeric.");
+        if(!value_greater(a, b))
+          ip += offset;
         break;
       }
-      case OP_LOOP:
+      case REG_LOOP:
       {
         uint16_t offset = READ_SHORT();
-        vm.ip -= offset;
+        ip -= offset;
         break;
       }
-      case OP_RETURN:
+      case REG_RETURN:
       {
+        reset_stack(vm);
         return INTERPRET_OK;
       }
     }
@@ -464,17 +1739,36 @@ static InterpretResult run()
 
 #undef READ_BYTE
 #undef READ_SHORT
-#undef READ_CONSTANT
-#undef READ_STRING
+#undef CONSTANT
 }
 
 /** @brief Reset the stack.
  *
  * Reset the stack.
  */
-static void reset_stack()
+static void reset_stack(VM *vm)
 {
-  vm.stack_top = vm.stack;
+  vm->stack_top = vm->stack;
+  vm->frame     = vm->stack;
+}
+
+/** @brief Double the capacity of the value stack.
+ *
+ * Grows the stack array and rebases stack_top on the new allocation.
+ * Called by push once the last free slot is used, so the stack always
+ * has room for the next value and growth never runs while the value
+ * being pushed is unrooted.
+ */
+static void grow_stack(VM *vm)
+{
+  int count        = (int)(vm->stack_top - vm->stack);
+  int frame        = (int)(vm->frame - vm->stack);
+  int old_capacity = vm->stack_capacity;
+
+  vm->stack_capacity = old_capacity < STACK_INITIAL ? STACK_INITIAL : old_capacity * 2;
+  vm->stack          = GROW_ARRAY(vm->stack, Value, old_capacity, vm->stack_capacity);
+  vm->stack_top      = vm->stack + count;
+  vm->frame          = vm->stack + frame;
 }
 
 /** @brief Display a runtime error message to stderr.
@@ -484,8 +1778,11 @@ static void reset_stack()
  *
  * @param format The standard printf style format string.
  */
-static void runtime_error(const char *format, ...)
+static void runtime_error(VM *vm, const char *format, ...)
 {
+  // Land any buffered program output before the error message.
+  writer_flush();
+
   va_list args;
   va_start(args, format);
   vfprintf(stderr, format, args);
@@ -493,10 +1790,34 @@ static void runtime_error(const char *format, ...)
   fputs("\n", stderr);
 
   // TODO: This will need to be updated when better source code positioning information is available.
-  size_t instruction = vm.ip - vm.chunk->code;
-  fprintf(stderr, "[line %d] in script\n", vm.chunk->lines[instruction]);
+  size_t instruction = vm->ip - vm->chunk->code;
+  fprintf(stderr, "[line %d] in script\n", chunk_get_line(vm->chunk, (int)instruction));
 
-  reset_stack();
+  reset_stack(vm);
+}
+
+/** @brief Display a runtime error from the register executor.
+ *
+ * The register executor keeps its own instruction pointer into the
+ * register code, so it cannot use runtime_error, which reports the
+ * line from vm->ip.
+ *
+ * @param format The standard printf style format string.
+ */
+static void register_error(VM *vm, RegChunk *reg, Byte *ip, const char *format, ...)
+{
+  // Land any buffered program output before the error message.
+  writer_flush();
+
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fputs("\n", stderr);
+
+  fprintf(stderr, "[line %d] in script\n", reg->lines[ip - reg->code]);
+
+  reset_stack(vm);
 }
 
 /** @brief Perform the greater than comparison operation.
@@ -504,41 +1825,41 @@ static void runtime_error(const char *format, ...)
  * Checks to see if operand one is greater than operand two. The values
  * can be either integer or real values.
  */
-static void do_greater()
+static void do_greater(VM *vm)
 {
-  if(IS_INTEGER(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    long b = AS_INTEGER(pop())->value;
-    long a = AS_INTEGER(pop())->value;
+    long b = AS_INTEGER(pop(vm));
+    long a = AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_boolean(a > b)));
+    push(vm, create_boolean(a > b));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_REAL(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_boolean(a > b)));
+    push(vm, create_boolean(a > b));
     return;
   }
 
-  if(IS_INTEGER(peek(0)) && IS_REAL(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = (double)AS_INTEGER(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = (double)AS_INTEGER(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_boolean(a > b)));
+    push(vm, create_boolean(a > b));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = (double)AS_INTEGER(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = (double)AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_boolean(a > b)));
+    push(vm, create_boolean(a > b));
     return;
   }
 }
@@ -548,41 +1869,41 @@ static void do_greater()
  * Check to see if operand one is less than operand two. The values
  * can be either integer or real values.
  */
-static void do_less()
+static void do_less(VM *vm)
 {
-  if(IS_INTEGER(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    long b = AS_INTEGER(pop())->value;
-    long a = AS_INTEGER(pop())->value;
+    long b = AS_INTEGER(pop(vm));
+    long a = AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_boolean(a < b)));
+    push(vm, create_boolean(a < b));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_REAL(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_boolean(a < b)));
+    push(vm, create_boolean(a < b));
     return;
   }
 
-  if(IS_INTEGER(peek(0)) && IS_REAL(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = (double)AS_INTEGER(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = (double)AS_INTEGER(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_boolean(a < b)));
+    push(vm, create_boolean(a < b));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = (double)AS_INTEGER(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = (double)AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_boolean(a < b)));
+    push(vm, create_boolean(a < b));
     return;
   }
 }
@@ -592,41 +1913,41 @@ static void do_less()
  * Adds two number values. The values can be either integer or real
  * values.
  */
-static void do_addition()
+static void do_addition(VM *vm)
 {
-  if(IS_INTEGER(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    long b = AS_INTEGER(pop())->value;
-    long a = AS_INTEGER(pop())->value;
+    long b = AS_INTEGER(pop(vm));
+    long a = AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_integer(a + b)));
+    push(vm, create_integer(a + b));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_REAL(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_real(a + b)));
+    push(vm, create_real(a + b));
     return;
   }
 
-  if(IS_INTEGER(peek(0)) && IS_REAL(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = (double)AS_INTEGER(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = (double)AS_INTEGER(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_real(a + b)));
+    push(vm, create_real(a + b));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = (double)AS_INTEGER(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = (double)AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_real(a + b)));
+    push(vm, create_real(a + b));
     return;
   }
 }
@@ -636,41 +1957,41 @@ static void do_addition()
  * Subtracts two number values. The values can be either integer or
  * real values.
  */
-static void do_subtraction()
+static void do_subtraction(VM *vm)
 {
-  if(IS_INTEGER(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    long b = AS_INTEGER(pop())->value;
-    long a = AS_INTEGER(pop())->value;
+    long b = AS_INTEGER(pop(vm));
+    long a = AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_integer(a - b)));
+    push(vm, create_integer(a - b));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_REAL(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_real(a - b)));
+    push(vm, create_real(a - b));
     return;
   }
 
-  if(IS_INTEGER(peek(0)) && IS_REAL(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = (double)AS_INTEGER(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = (double)AS_INTEGER(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_real(a - b)));
+    push(vm, create_real(a - b));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = (double)AS_INTEGER(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = (double)AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_real(a - b)));
+    push(vm, create_real(a - b));
     return;
   }
 }
@@ -680,41 +2001,41 @@ static void do_subtraction()
  * Multiplies two number values. The values can be either integer or
  * real values.
  */
-static void do_multiplication()
+static void do_multiplication(VM *vm)
 {
-  if(IS_INTEGER(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    long b = AS_INTEGER(pop())->value;
-    long a = AS_INTEGER(pop())->value;
+    long b = AS_INTEGER(pop(vm));
+    long a = AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_integer(a * b)));
+    push(vm, create_integer(a * b));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_REAL(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_real(a * b)));
+    push(vm, create_real(a * b));
     return;
   }
 
-  if(IS_INTEGER(peek(0)) && IS_REAL(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = (double)AS_INTEGER(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = (double)AS_INTEGER(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_real(a * b)));
+    push(vm, create_real(a * b));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = (double)AS_INTEGER(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = (double)AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_real(a * b)));
+    push(vm, create_real(a * b));
     return;
   }
 }
@@ -724,41 +2045,41 @@ static void do_multiplication()
  * Divide two number values. The values can be either integer or real
  * values.
  */
-static void do_division()
+static void do_division(VM *vm)
 {
-  if(IS_INTEGER(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    long b = AS_INTEGER(pop())->value;
-    long a = AS_INTEGER(pop())->value;
+    long b = AS_INTEGER(pop(vm));
+    long a = AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_integer(a / b)));
+    push(vm, create_integer(a / b));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_REAL(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_real(a / b)));
+    push(vm, create_real(a / b));
     return;
   }
 
-  if(IS_INTEGER(peek(0)) && IS_REAL(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = (double)AS_INTEGER(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = (double)AS_INTEGER(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_real(a / b)));
+    push(vm, create_real(a / b));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = (double)AS_INTEGER(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = (double)AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_real(a / b)));
+    push(vm, create_real(a / b));
     return;
   }
 }
@@ -767,97 +2088,167 @@ static void do_division()
  *
  * Take the modulus of two integers. The values must be integers.
  */
-static void do_modulo()
+static void do_modulo(VM *vm)
 {
-  long b = AS_INTEGER(pop())->value;
-  long a = AS_INTEGER(pop())->value;
+  long b = AS_INTEGER(pop(vm));
+  long a = AS_INTEGER(pop(vm));
 
-  push(AS_OBJECT(create_integer(a % b)));
+  push(vm, create_integer(a % b));
 }
 
 /** @brief Perform the exponentiation operation.
  *
  * Raise an integer to a power of another integer.
  */
-static void do_power()
+static void do_power(VM *vm)
 {
-  if(IS_INTEGER(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    double b = (double)AS_INTEGER(pop())->value;
-    double a = (double)AS_INTEGER(pop())->value;
+    double b = (double)AS_INTEGER(pop(vm));
+    double a = (double)AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_integer(pow(a, b))));
+    push(vm, create_integer(pow(a, b)));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_REAL(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_real(pow(a, b))));
+    push(vm, create_real(pow(a, b)));
     return;
   }
 
-  if(IS_INTEGER(peek(0)) && IS_REAL(peek(1)))
+  if(IS_INTEGER(peek(vm, 0)) && IS_REAL(peek(vm, 1)))
   {
-    double b = (double)AS_INTEGER(pop())->value;
-    double a = AS_REAL(pop())->value;
+    double b = (double)AS_INTEGER(pop(vm));
+    double a = AS_REAL(pop(vm));
 
-    push(AS_OBJECT(create_real(pow(a, b))));
+    push(vm, create_real(pow(a, b)));
     return;
   }
 
-  if(IS_REAL(peek(0)) && IS_INTEGER(peek(1)))
+  if(IS_REAL(peek(vm, 0)) && IS_INTEGER(peek(vm, 1)))
   {
-    double b = AS_REAL(pop())->value;
-    double a = (double)AS_INTEGER(pop())->value;
+    double b = AS_REAL(pop(vm));
+    double a = (double)AS_INTEGER(pop(vm));
 
-    push(AS_OBJECT(create_real(pow(a, b))));
+    push(vm, create_real(pow(a, b)));
     return;
   }
 }
 
+/** Convert a numeric value to a double for mixed arithmetic. */
+#define AS_DOUBLE(value) (IS_REAL(value) ? AS_REAL(value) : (double)AS_INTEGER(value))
+
+/** @brief Add two numeric values for the register executor. */
+static Value value_add(Value a, Value b)
+{
+  if(IS_INTEGER(a) && IS_INTEGER(b))
+    return create_integer(AS_INTEGER(a) + AS_INTEGER(b));
+
+  return create_real(AS_DOUBLE(a) + AS_DOUBLE(b));
+}
+
+/** @brief Subtract two numeric values for the register executor. */
+static Value value_subtract(Value a, Value b)
+{
+  if(IS_INTEGER(a) && IS_INTEGER(b))
+    return create_integer(AS_INTEGER(a) - AS_INTEGER(b));
+
+  return create_real(AS_DOUBLE(a) - AS_DOUBLE(b));
+}
+
+/** @brief Multiply two numeric values for the register executor. */
+static Value value_multiply(Value a, Value b)
+{
+  if(IS_INTEGER(a) && IS_INTEGER(b))
+    return create_integer(AS_INTEGER(a) * AS_INTEGER(b));
+
+  return create_real(AS_DOUBLE(a) * AS_DOUBLE(b));
+}
+
+/** @brief Divide two numeric values for the register executor. */
+static Value value_divide(Value a, Value b)
+{
+  if(IS_INTEGER(a) && IS_INTEGER(b))
+    return create_integer(AS_INTEGER(a) / AS_INTEGER(b));
+
+  return create_real(AS_DOUBLE(a) / AS_DOUBLE(b));
+}
+
+/** @brief Exponentiate two numeric values for the register executor. */
+static Value value_power(Value a, Value b)
+{
+  if(IS_INTEGER(a) && IS_INTEGER(b))
+    return create_integer(pow((double)AS_INTEGER(a), (double)AS_INTEGER(b)));
+
+  return create_real(pow(AS_DOUBLE(a), AS_DOUBLE(b)));
+}
+
+/** @brief Compare two numeric values for the register executor. */
+static bool value_less(Value a, Value b)
+{
+  if(IS_INTEGER(a) && IS_INTEGER(b))
+    return AS_INTEGER(a) < AS_INTEGER(b);
+
+  return AS_DOUBLE(a) < AS_DOUBLE(b);
+}
+
+/** @brief Compare two numeric values for the register executor. */
+static bool value_greater(Value a, Value b)
+{
+  if(IS_INTEGER(a) && IS_INTEGER(b))
+    return AS_INTEGER(a) > AS_INTEGER(b);
+
+  return AS_DOUBLE(a) > AS_DOUBLE(b);
+}
+
+#undef AS_DOUBLE
+
 /** @brief Perform a negation operation.
  *
  * Negate the numeric value.
  */
-static void do_negate()
+static void do_negate(VM *vm)
 {
-  Object *v = pop();
-  switch(v->type)
+  Value v = pop(vm);
+  switch(VALUE_TYPE(v))
   {
-    case OBJ_INTEGER:
-      push(AS_OBJECT(create_integer(-AS_INTEGER(v)->value)));
+    case VAL_INTEGER:
+      push(vm, create_integer(-AS_INTEGER(v)));
       break;
-    case OBJ_REAL:
-      push(AS_OBJECT(create_real(-AS_REAL(v)->value)));
+    case VAL_REAL:
+      push(vm, create_real(-AS_REAL(v)));
       break;
     default:
       break;
   }
 }
 
-/** @brief Check if the object is false.
+/** @brief Check if the value is false.
  *
  * False is defined as NIL or `false`. Everything else is true.
  *
- * @param object The object to check for false-ness.
- * @return True if the object is false, otherwise false.
+ * @param value The value to check for false-ness.
+ * @return True if the value is false, otherwise false.
  */
-static bool is_falsey(Object *object)
+static bool is_falsey(Value value)
 {
-  return IS_NIL(object) || (IS_BOOLEAN(object) && !AS_BOOLEAN(object)->value);
+  return IS_NIL(value) || (IS_BOOLEAN(value) && !AS_BOOLEAN(value));
 }
 
 /** @brief Concatenate two ObjectString objects.
  *
  * Used for string concatenation using the '+' operator.
  */
-static void do_concatenate()
+static void do_concatenate(VM *vm)
 {
-  ObjectString *b = AS_STRING(pop());
-  ObjectString *a = AS_STRING(pop());
+  // Leave the operands on the stack while allocating so a collection
+  // triggered by the allocation cannot free them out from under us.
+  ObjectString *b = AS_STRING(peek(vm, 0));
+  ObjectString *a = AS_STRING(peek(vm, 1));
 
   int length = a->length + b->length;
   char *chars = ALLOC(char, length + 1);
@@ -866,5 +2257,7 @@ static void do_concatenate()
   chars[length] = '\0';
 
   ObjectString *result = take_string(chars, length);
-  push(AS_OBJECT(result));
+  pop(vm);
+  pop(vm);
+  push(vm, create_object((Object*)result));
 }
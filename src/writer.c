@@ -0,0 +1,114 @@
+/** @file writer.c
+ *
+ * @brief Implementation of the buffered output writer.
+ *
+ * @author David J. Lains (dlains)
+ * @bug No known bugs.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include "writer.h"
+
+/** The output buffer. Filled by the writer functions and drained to
+ * stdout by writer_flush. */
+static __thread char buffer[WRITER_BUFFER_SIZE];
+
+/** The number of buffered bytes. */
+static __thread size_t used = 0;
+
+/** @brief Append raw characters to the output buffer.
+ *
+ * Flushes first when the characters do not fit, and writes spans
+ * larger than the whole buffer straight through.
+ *
+ * @param chars The characters to append.
+ * @param length The number of characters to append.
+ */
+void writer_string(const char *chars, size_t length)
+{
+  if(used + length > WRITER_BUFFER_SIZE)
+    writer_flush();
+
+  // A span larger than the whole buffer would never fit, so it
+  // bypasses the buffer entirely. The flush above kept the order.
+  if(length > WRITER_BUFFER_SIZE)
+  {
+    fwrite(chars, sizeof(char), length, stdout);
+    return;
+  }
+
+  memcpy(buffer + used, chars, length);
+  used += length;
+}
+
+/** @brief Append a single character to the output buffer.
+ *
+ * @param c The character to append.
+ */
+void writer_char(char c)
+{
+  if(used == WRITER_BUFFER_SIZE)
+    writer_flush();
+
+  buffer[used++] = c;
+}
+
+/** @brief Format an integer into the output buffer.
+ *
+ * Converts the value directly, avoiding printf format parsing for
+ * the most common printed type.
+ *
+ * @param value The integer to append.
+ */
+void writer_integer(long value)
+{
+  // Build the digits back to front in a scratch array that is large
+  // enough for the widest long, including the sign.
+  char digits[24];
+  char *at = digits + sizeof(digits);
+
+  // Negate into unsigned space so the most negative long converts
+  // without overflowing.
+  unsigned long rest = value < 0 ? -(unsigned long)value : (unsigned long)value;
+  do
+  {
+    *--at = (char)('0' + rest % 10);
+    rest /= 10;
+  } while(rest > 0);
+
+  if(value < 0)
+    *--at = '-';
+
+  writer_string(at, (size_t)(digits + sizeof(digits) - at));
+}
+
+/** @brief Format a real into the output buffer.
+ *
+ * Matches the %g formatting the VM has always used for reals.
+ *
+ * @param value The real to append.
+ */
+void writer_real(double value)
+{
+  char scratch[32];
+  int length = snprintf(scratch, sizeof(scratch), "%g", value);
+  writer_string(scratch, (size_t)length);
+}
+
+/** @brief Write the buffered output to stdout.
+ *
+ * Called when the buffer fills, when interpret() returns and on the
+ * runtime error path, so buffered output always lands before any
+ * error message.
+ */
+void writer_flush(void)
+{
+  if(used > 0)
+  {
+    fwrite(buffer, sizeof(char), used, stdout);
+    used = 0;
+  }
+
+  fflush(stdout);
+}
@@ -0,0 +1,166 @@
+/** @file benchmark.c
+ *
+ * @brief Benchmark harness for the Cube interpreter.
+ *
+ * Runs each benchmark script a number of times under a child process
+ * and reports the wall time per run with its variance, along with the
+ * peak resident set size reported by wait4. Each script gets one
+ * untimed warm up run first, so the timed runs measure the interpreter
+ * with a primed bytecode cache rather than the first-run compile.
+ *
+ * Usage: benchmark <cube-binary> <iterations> <script>...
+ *
+ * @author David J. Lains (dlains)
+ * @bug No known bugs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/** @brief Run the interpreter on a script once.
+ *
+ * Forks, redirects the child's stdout to /dev/null and execs the
+ * interpreter. Reports the wall time of the run and the peak resident
+ * set size of the child.
+ *
+ * @param binary The path to the cube binary.
+ * @param script The path to the script to run.
+ * @param seconds Receives the wall time of the run.
+ * @param max_rss Receives the peak RSS of the run in kilobytes.
+ * @return True if the run succeeded.
+ */
+static int run_once(const char *binary, const char *script, double *seconds, long *max_rss)
+{
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  pid_t pid = fork();
+  if(pid == -1)
+    return 0;
+
+  if(pid == 0)
+  {
+    int devnull = open("/dev/null", O_WRONLY);
+    if(devnull != -1)
+    {
+      dup2(devnull, STDOUT_FILENO);
+      close(devnull);
+    }
+    execl(binary, binary, script, (char*)NULL);
+    _exit(127);
+  }
+
+  int status;
+  struct rusage usage;
+  if(wait4(pid, &status, 0, &usage) == -1)
+    return 0;
+
+  struct timespec stop;
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+
+  if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    return 0;
+
+  *seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+  *max_rss = usage.ru_maxrss;
+  return 1;
+}
+
+/** @brief Remove the bytecode cache file for a script.
+ *
+ * The warm up run leaves a .cubec file next to the script. Removing
+ * it afterwards keeps the benchmark directory clean.
+ *
+ * @param script The path to the script.
+ */
+static void remove_cache(const char *script)
+{
+  size_t length = strlen(script);
+  char *path = malloc(length + 7);
+  if(path == NULL)
+    return;
+
+  strcpy(path, script);
+  if(length >= 5 && strcmp(script + length - 5, ".cube") == 0)
+    strcat(path, "c");
+  else
+    strcat(path, ".cubec");
+
+  remove(path);
+  free(path);
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 4)
+  {
+    fprintf(stderr, "Usage: benchmark <cube-binary> <iterations> <script>...\n");
+    return 1;
+  }
+
+  const char *binary = argv[1];
+  int iterations = atoi(argv[2]);
+  if(iterations < 1)
+  {
+    fprintf(stderr, "Iterations must be at least 1.\n");
+    return 1;
+  }
+
+  printf("%-24s %12s %12s %12s\n", "benchmark", "mean (s)", "stddev (s)", "peak RSS (K)");
+
+  int failures = 0;
+  for(int i = 3; i < argc; i++)
+  {
+    const char *script = argv[i];
+
+    // Warm up: compiles the script and primes the bytecode cache.
+    double seconds;
+    long max_rss;
+    if(!run_once(binary, script, &seconds, &max_rss))
+    {
+      fprintf(stderr, "%-24s failed\n", script);
+      remove_cache(script);
+      failures++;
+      continue;
+    }
+
+    double sum = 0.0;
+    double sum_squares = 0.0;
+    long peak_rss = 0;
+    int runs = 0;
+    for(int run = 0; run < iterations; run++)
+    {
+      if(!run_once(binary, script, &seconds, &max_rss))
+        break;
+
+      sum         += seconds;
+      sum_squares += seconds * seconds;
+      if(max_rss > peak_rss)
+        peak_rss = max_rss;
+      runs++;
+    }
+
+    remove_cache(script);
+
+    if(runs < iterations)
+    {
+      fprintf(stderr, "%-24s failed\n", script);
+      failures++;
+      continue;
+    }
+
+    double mean     = sum / runs;
+    double variance = sum_squares / runs - mean * mean;
+    double stddev   = variance > 0.0 ? sqrt(variance) : 0.0;
+
+    printf("%-24s %12.4f %12.4f %12ld\n", script, mean, stddev, peak_rss);
+  }
+
+  return failures == 0 ? 0 : 1;
+}
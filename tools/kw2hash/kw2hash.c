@@ -1,39 +1,99 @@
-#include <stdio.h>
-
-/** @brief A maximum value for the hash function to use.
+/** @file kw2hash.c
+ *
+ * @brief Generate the perfect hash keyword table for src/keywords.c.
+ *
+ * Given the full keyword list on the command line, searches for the
+ * smallest table size and multiplier pair that maps every keyword to
+ * its own slot using only its first character, last character and
+ * length. The resulting table is printed as C code ready to paste
+ * into src/keywords.c, so the scanner can classify an identifier with
+ * one table index and at most one memcmp.
  *
- * @def HASH_MAX Generate hash values between 0 and 7919.
+ * Usage:
+ *
+ *   kw2hash begin break case ... while
+ *
+ * @author David J. Lains (dlains)
+ * @bug No known bugs.
  */
-#define HASH_MAX 7919
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
 
-/** @brief Generate a hash value for the given string.
- *
- * Uses the universal string hash from (Algorithms in C)[https://www.amazon.com/Algorithms-Parts-1-4-Fundamentals-Structures/dp/0201314525].
- * Generates a hash value between 0 and HASH_MAX for the given word.
+/** The widest search ranges tried before giving up. */
+#define MAX_TABLE_SIZE 512
+#define MAX_MULTIPLIER 512
+
+/** @brief The perfect hash over first character, last character and length.
  *
- * @param word A string to generate a hash value for.
- * @return The generated hash value.
+ * @param word The keyword to hash.
+ * @param a The multiplier for the first character.
+ * @param b The multiplier for the last character.
+ * @param size The table size to reduce into.
+ * @return The table slot for the word.
  */
-static int hash(const char *word)
+static int hash(const char *word, int a, int b, int size)
 {
-  int h, a = 31415, b = 27183;
-  for(h = 0; *word != '\0'; word++, a = a * b % (HASH_MAX - 1))
-    h = (a * h + *word) % HASH_MAX;
-
-  return h;
+  int length = (int)strlen(word);
+  return (a * word[0] + b * word[length - 1] + length) % size;
 }
 
 int main(int argc, char *argv[])
 {
   if(argc < 2)
   {
-    printf("Usage: kw2hash keyword");
+    printf("Usage: kw2hash keyword...\n");
     return 1;
   }
 
-  int result = hash(argv[1]);
+  int count = argc - 1;
+  char **words = argv + 1;
+
+  // Find the smallest table with a collision free multiplier pair.
+  int size, a = 0, b = 0;
+  for(size = count; size <= MAX_TABLE_SIZE; size++)
+  {
+    for(a = 1; a <= MAX_MULTIPLIER; a++)
+    {
+      for(b = 1; b <= MAX_MULTIPLIER; b++)
+      {
+        int used[MAX_TABLE_SIZE] = { 0 };
+        int collided = 0;
+        for(int i = 0; i < count; i++)
+        {
+          int slot = hash(words[i], a, b, size);
+          if(used[slot])
+          {
+            collided = 1;
+            break;
+          }
+          used[slot] = 1;
+        }
+        if(!collided)
+          goto found;
+      }
+    }
+  }
+
+  printf("No perfect hash found for %d keywords.\n", count);
+  return 1;
 
-  printf("The hash value for %s is %d\n", argv[1], result);
+found:
+  printf("/* Generated by tools/kw2hash. Do not edit by hand. */\n");
+  printf("#define KEYWORD_TABLE_SIZE %d\n", size);
+  printf("#define KEYWORD_MULT_FIRST %d\n", a);
+  printf("#define KEYWORD_MULT_LAST  %d\n", b);
+  printf("\n");
+  printf("static const Keyword keywords[KEYWORD_TABLE_SIZE] = {\n");
+  for(int i = 0; i < count; i++)
+  {
+    int length = (int)strlen(words[i]);
+    printf("  [%2d] = { TOKEN_", hash(words[i], a, b, size));
+    for(int c = 0; c < length; c++)
+      putchar(toupper((unsigned char)words[i][c]));
+    printf(", %d, \"%s\" },\n", length, words[i]);
+  }
+  printf("};\n");
 
   return 0;
 }